@@ -0,0 +1,298 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <functional>
+#include <cstdio>
+#include <sys/stat.h>
+#include "select_free_boss.hh"
+#include "original_boss.hh"
+#include "wheeler_boss.hh"
+#include "sequence_reader.hh"
+
+using std::string;
+using std::vector;
+
+// Compares the BOSS variants on the same input. For every k and input size, each
+// variant is built and queried, and one tab-separated line of measurements is printed:
+//
+//   variant k bases nodes kmers construct_s peak_rss_mb index_bytes bits_per_kmer
+//   pos_qps neg_qps pos_p50_ns pos_p90_ns pos_p99_ns pos_p999_ns neg_p50_ns ... neg_p999_ns popcount
+//
+// peak_rss_mb is the peak resident set size of the process during construction, which
+// includes the input. index_bytes is the size of the index file. Positive queries are
+// k-mers sampled from the input and negative queries are random k-mers that are not in it.
+// Every variant is built with n_threads threads (-t); only the packing passes of BOSS
+// and WheelerBOSS are sequential. Queries run on one thread. Throughput is measured on the whole query set and latency
+// percentiles by timing each query separately. SelectFreeBOSS-interleaved uses the
+// interleaved SBWT layout and SelectFreeBOSS-compressed the RRR compressed SBWT bit
+// vectors. WheelerBOSS-compressed stores the I and O bit vectors of WheelerBOSS RRR
+// compressed. With -p, SelectFreeBOSS is also run
+// with a prefix table, as variant SelectFreeBOSS-p<length>. popcount is the name of
+// the rank kernels in use (see popcount.h).
+
+const char* index_filename = "benchmark.index";
+
+// Resets the peak RSS reported by peak_rss_mb. Returns false if the kernel does not support it.
+bool reset_peak_rss(){
+  std::ofstream clear_refs("/proc/self/clear_refs");
+  clear_refs << "5";
+  clear_refs.close();
+  return !clear_refs.fail();
+}
+
+double peak_rss_mb(){
+  std::ifstream status("/proc/self/status");
+  string line;
+  while(std::getline(status, line))
+    if(line.compare(0, 6, "VmHWM:") == 0) return std::stod(line.substr(6)) / 1024; // In kB
+  return -1;
+}
+
+int64_t file_size(const string& filename){
+  struct stat st;
+  if(stat(filename.c_str(), &st) != 0) return -1;
+  return st.st_size;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start){
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Random sequences of length piece_length with n_bases characters in total
+vector<string> generate_input(int64_t n_bases, int64_t piece_length, std::mt19937_64& rng){
+  vector<string> input;
+  for(int64_t generated = 0; generated < n_bases; generated += piece_length){
+    string S(std::min(piece_length, n_bases - generated), 'A');
+    for(char& c : S) c = "ACGT"[rng() & 3];
+    input.push_back(S);
+  }
+  return input;
+}
+
+// The first n_bases characters of the ACGT pieces of the file
+vector<string> load_input(const string& filename, int64_t n_bases, int k){
+  SequenceReader reader(filename);
+  vector<string> input;
+  int64_t bases = 0;
+  string header, sequence;
+  while(bases < n_bases && reader.next_read(header, sequence))
+    SequenceReader::split_at_non_ACGT(sequence, k, input, bases);
+  while(bases > n_bases){ // Trim the overshoot of the last read
+    int64_t excess = std::min<int64_t>(bases - n_bases, input.back().size());
+    input.back().resize(input.back().size() - excess);
+    bases -= excess;
+    if(input.back().size() < (size_t)k) input.pop_back();
+  }
+  return input;
+}
+
+struct QuerySet{
+  vector<string> positive, negative;
+  int64_t n_nodes = 0, n_kmers = 0;
+};
+
+// Samples the queries. The node list of the input is used to count the k-mers and to
+// reject random k-mers that happen to occur in the input.
+template <typename kmer_t>
+QuerySet make_queries(const vector<string>& input, int k, int64_t n_queries, int n_threads, std::mt19937_64& rng){
+  QuerySet queries;
+  vector<KmerNode<kmer_t>> nodes = construct_node_list<kmer_t>(input, k, n_threads);
+  queries.n_nodes = nodes.size();
+  for(const KmerNode<kmer_t>& node : nodes) queries.n_kmers += node.length == k;
+
+  vector<int64_t> piece_ends; // Cumulative number of k-mers of the pieces
+  int64_t total = 0;
+  for(const string& S : input){
+    total += S.size() >= (size_t)k ? S.size() - k + 1 : 0;
+    piece_ends.push_back(total);
+  }
+  if(total == 0) return queries;
+
+  for(int64_t q = 0; q < n_queries; q++){
+    int64_t x = rng() % total;
+    int64_t piece = std::upper_bound(piece_ends.begin(), piece_ends.end(), x) - piece_ends.begin();
+    int64_t offset = x - (piece > 0 ? piece_ends[piece-1] : 0);
+    queries.positive.push_back(input[piece].substr(offset, k));
+  }
+
+  // Give up on negatives if almost all k-mers are present
+  for(int64_t attempts = 0; (int64_t)queries.negative.size() < n_queries && attempts < 100 * n_queries; attempts++){
+    string kmer(k, 'A');
+    kmer_t key = 0;
+    for(int i = 0; i < k; i++){
+      kmer[i] = "ACGT"[rng() & 3];
+      key = (key >> 2) | (kmer_t(nucleotide_code(kmer[i])) << (2*(k-1)));
+    }
+    KmerNode<kmer_t> node = {key, (uint8_t)k, 0};
+    if(!std::binary_search(nodes.begin(), nodes.end(), node)) queries.negative.push_back(kmer);
+  }
+  return queries;
+}
+
+// Queries per second and latency percentiles in nanoseconds
+vector<double> time_queries(const vector<string>& queries, const std::function<int64_t(const string&)>& query){
+  vector<double> results;
+  if(queries.empty()) return vector<double>(5, 0);
+  int64_t checksum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for(const string& kmer : queries) checksum += query(kmer);
+  results.push_back(queries.size() / seconds_since(start));
+
+  vector<double> latencies;
+  for(const string& kmer : queries){
+    auto query_start = std::chrono::steady_clock::now();
+    checksum += query(kmer);
+    latencies.push_back(seconds_since(query_start) * 1e9);
+  }
+  std::sort(latencies.begin(), latencies.end());
+  for(double p : {0.5, 0.9, 0.99, 0.999})
+    results.push_back(latencies[std::min<int64_t>(p * latencies.size(), latencies.size() - 1)]);
+  if(checksum == 42) std::cerr << ""; // Keeps the queries from being optimized out
+  return results;
+}
+
+// Builds one variant and prints its line. `build` constructs the structure and
+// returns the query function, and `save` writes the structure to index_filename.
+void run_variant(const string& name, int k, int64_t bases, const QuerySet& queries,
+                 const std::function<std::function<int64_t(const string&)>()>& build,
+                 const std::function<void()>& save){
+  bool rss_supported = reset_peak_rss();
+  auto start = std::chrono::steady_clock::now();
+  std::function<int64_t(const string&)> query = build();
+  double construct_s = seconds_since(start);
+  double rss = rss_supported ? peak_rss_mb() : -1;
+  save();
+  int64_t index_bytes = file_size(index_filename);
+  remove(index_filename);
+
+  for(const string& kmer : queries.positive)
+    if(query(kmer) < 0){
+      std::cerr << "ERROR: " << name << " did not find k-mer " << kmer << '\n';
+      break;
+    }
+  for(const string& kmer : queries.negative)
+    if(query(kmer) >= 0){
+      std::cerr << "ERROR: " << name << " found k-mer " << kmer << " that is not in the input" << '\n';
+      break;
+    }
+
+  vector<double> positive = time_queries(queries.positive, query);
+  vector<double> negative = time_queries(queries.negative, query);
+  std::cout << name << '\t' << k << '\t' << bases << '\t' << queries.n_nodes << '\t' << queries.n_kmers
+            << '\t' << construct_s << '\t' << rss << '\t' << index_bytes
+            << '\t' << (queries.n_kmers > 0 ? 8.0 * index_bytes / queries.n_kmers : 0)
+            << '\t' << positive[0] << '\t' << negative[0];
+  for(int i = 1; i < 5; i++) std::cout << '\t' << positive[i];
+  for(int i = 1; i < 5; i++) std::cout << '\t' << negative[i];
+  std::cout << '\t' << popcount_kernels->name << std::endl;
+}
+
+vector<int64_t> parse_list(const string& S){
+  vector<int64_t> values;
+  std::stringstream ss(S);
+  string item;
+  while(std::getline(ss, item, ',')) values.push_back(std::stoll(item));
+  return values;
+}
+
+int main(int argc, char** argv){
+  vector<int64_t> ks = {15, 31, 63};
+  vector<int64_t> sizes = {1000000, 10000000};
+  int64_t n_queries = 100000;
+  int prefix_length = 0;
+  int n_threads = std::max<int>(std::thread::hardware_concurrency(), 1);
+  string input_file;
+  uint64_t seed = 1;
+  for(int i = 1; i < argc; i += 2){
+    string arg = argv[i];
+    string value = i + 1 < argc ? argv[i+1] : "";
+    if(value.empty()) arg = ""; // Prints the usage
+    if(arg == "-k") ks = parse_list(value);
+    else if(arg == "-n") sizes = parse_list(value);
+    else if(arg == "-q") n_queries = std::stoll(value);
+    else if(arg == "-t") n_threads = std::max(std::stoi(value), 1);
+    else if(arg == "-i") input_file = value;
+    else if(arg == "-s") seed = std::stoull(value);
+    else if(arg == "-p") prefix_length = std::stoi(value);
+    else {
+      std::cerr << "Usage: " << argv[0] << " [-k 15,31,63] [-n bases,...] [-q queries] [-t threads] [-i input.fasta[.gz]] [-s seed] [-p prefix_length]" << '\n';
+      return 1;
+    }
+  }
+
+  construction_dump = false;
+  std::cout << "variant\tk\tbases\tnodes\tkmers\tconstruct_s\tpeak_rss_mb\tindex_bytes\tbits_per_kmer\tpos_qps\tneg_qps"
+            << "\tpos_p50_ns\tpos_p90_ns\tpos_p99_ns\tpos_p999_ns\tneg_p50_ns\tneg_p90_ns\tneg_p99_ns\tneg_p999_ns\tpopcount" << std::endl;
+  try{
+    for(int64_t bases : sizes){
+      for(int64_t k : ks){
+        std::mt19937_64 rng(seed);
+        vector<string> input = input_file.empty() ? generate_input(bases, 10000, rng) : load_input(input_file, bases, k);
+        int64_t total_bases = 0;
+        for(const string& S : input) total_bases += S.size();
+        QuerySet queries = k <= 32 ? make_queries<uint64_t>(input, k, n_queries, n_threads, rng)
+                                   : make_queries<__uint128_t>(input, k, n_queries, n_threads, rng);
+
+        std::shared_ptr<SelectFreeBOSS> select_free;
+        run_variant("SelectFreeBOSS", k, total_bases, queries, [&](){
+          select_free = std::make_shared<SelectFreeBOSS>(input, k, n_threads);
+          return [&](const string& kmer){ return search(*select_free, kmer); };
+        }, [&](){ select_free->save(index_filename); });
+        select_free.reset();
+
+        run_variant("SelectFreeBOSS-interleaved", k, total_bases, queries, [&](){
+          select_free = std::make_shared<SelectFreeBOSS>(input, k, n_threads);
+          select_free->set_layout(SelectFreeBOSS::INTERLEAVED);
+          return [&](const string& kmer){ return search(*select_free, kmer); };
+        }, [&](){ select_free->save(index_filename); });
+        select_free.reset();
+
+        run_variant("SelectFreeBOSS-compressed", k, total_bases, queries, [&](){
+          select_free = std::make_shared<SelectFreeBOSS>(input, k, n_threads);
+          select_free->set_layout(SelectFreeBOSS::COMPRESSED);
+          return [&](const string& kmer){ return search(*select_free, kmer); };
+        }, [&](){ select_free->save(index_filename); });
+        select_free.reset();
+
+        // With -p, also SelectFreeBOSS with a prefix table of min(p, k) characters
+        if(prefix_length > 0){
+          int p = std::min<int>(prefix_length, k);
+          run_variant("SelectFreeBOSS-p" + std::to_string(p), k, total_bases, queries, [&](){
+            select_free = std::make_shared<SelectFreeBOSS>(input, k, n_threads);
+            select_free->build_prefix_table(p, n_threads);
+            return [&](const string& kmer){ return search(*select_free, kmer); };
+          }, [&](){ select_free->save(index_filename); });
+          select_free.reset();
+        }
+
+        std::shared_ptr<BOSS> boss;
+        run_variant("BOSS", k, total_bases, queries, [&](){
+          boss = std::make_shared<BOSS>(construct(input, k, false, n_threads));
+          return [&](const string& kmer){ return search(*boss, kmer); };
+        }, [&](){ save(*boss, index_filename); });
+        boss.reset();
+
+        for(bool compressed : {false, true}){
+          std::shared_ptr<WheelerBOSS> wheeler;
+          run_variant(compressed ? "WheelerBOSS-compressed" : "WheelerBOSS", k, total_bases, queries, [&](){
+            wheeler = std::shared_ptr<WheelerBOSS>(new WheelerBOSS(construct_wheeler_boss(input, k, n_threads)),
+                                                   [](WheelerBOSS* w){ WheelerBOSS_free(w); delete w; });
+            if(compressed) WheelerBOSS_compress(wheeler.get());
+            return [&](const string& kmer){ return WheelerBOSS_search(wheeler.get(), kmer.c_str(), kmer.size()); };
+          }, [&](){
+            if(WheelerBOSS_save(wheeler.get(), index_filename) != 0) throw std::runtime_error("Could not write " + string(index_filename));
+          });
+        }
+      }
+    }
+  } catch(const std::exception& e){
+    std::cerr << "ERROR: " << e.what() << '\n';
+    return 1;
+  }
+}
@@ -0,0 +1,271 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <algorithm>
+#include "serialization.hh"
+#include "popcount.h"
+#include "rrr_vector.h"
+#include "query_counters.h"
+
+using std::string;
+using std::vector;
+using std::ostream;
+
+// Packed bit vector with a two-level rank directory.
+// Superblocks of 2^16 bits store the absolute number of ones before them,
+// and blocks of 512 bits (8 words) store the count relative to their superblock.
+// A rank query is one lookup in each level plus at most 8 popcounts.
+// Select support is optional: the block of every SELECT_SAMPLE-th one is sampled,
+// and a query binary searches the blocks between two samples.
+// After compress() the bits are stored in RRR form instead (see rrr_vector.h):
+// smaller, read-only, and several times slower to query.
+class BitVector{
+public:
+  static const int64_t BLOCK_BITS = 512;
+  static const int64_t SUPERBLOCK_BITS = 1 << 16;
+  static const int64_t SELECT_SAMPLE = 1024;
+
+  Array<uint64_t> words;
+  Array<uint64_t> superblock_ranks;
+  Array<uint16_t> block_ranks;
+  Array<int64_t> select_samples;
+  int64_t n_bits = 0;
+
+  // The RRR representation. Used instead of the arrays above if `compressed` is set.
+  bool compressed = false;
+  int64_t n_ones = 0;
+  Array<uint64_t> rrr_classes;
+  Array<uint64_t> rrr_offsets;
+  Array<int64_t> rrr_samples;
+
+  BitVector() {}
+  BitVector(int64_t size) : words((size + 63) / 64), n_bits(size) {}
+
+  // From a string of digits '0' and '1'
+  BitVector(const string& bits) : BitVector(bits.size()) {
+    for(int64_t i = 0; i < n_bits; i++)
+      if(bits[i] == '1') set(i, 1);
+  }
+
+  int64_t size() const { return n_bits; }
+
+  bool operator[](int64_t i) const {
+    if(compressed){
+      RRRVector R = rrr();
+      return RRR_Access(&R, i);
+    }
+    return (words[i >> 6] >> (i & 63)) & 1;
+  }
+
+  void set(int64_t i, bool value){
+    if(value) words[i >> 6] |= uint64_t(1) << (i & 63);
+    else words[i >> 6] &= ~(uint64_t(1) << (i & 63));
+  }
+
+  // Must be called after the last modification and before the first rank query
+  void init_rank_support(){
+    int64_t n_blocks = (n_bits + BLOCK_BITS - 1) / BLOCK_BITS;
+    block_ranks.assign(n_blocks + 1, 0);
+    superblock_ranks.assign(n_bits / SUPERBLOCK_BITS + 2, 0);
+    uint64_t total = 0;
+    for(int64_t b = 0; b <= n_blocks; b++){
+      int64_t bit = b * BLOCK_BITS;
+      if(bit % SUPERBLOCK_BITS == 0) superblock_ranks[bit / SUPERBLOCK_BITS] = total;
+      block_ranks[b] = total - superblock_ranks[bit / SUPERBLOCK_BITS];
+      if(b * 8 < (int64_t)words.size()) total += popcount_prefix(words.data() + b * 8, 64 * std::min<int64_t>(8, words.size() - b * 8));
+    }
+  }
+
+  // Counts the number of ones in [0..position)
+  int64_t rank1(int64_t position) const {
+    BOSS_COUNT(rank_calls);
+    if(compressed){
+      RRRVector R = rrr();
+      return RRR_Rank(&R, '1', position);
+    }
+    int64_t block = position / BLOCK_BITS;
+    int64_t ans = superblock_ranks[position / SUPERBLOCK_BITS] + block_ranks[block];
+    return ans + popcount_prefix(words.data() + block * 8, position - block * BLOCK_BITS);
+  }
+
+  // Brings the memory that rank1(position) reads into the cache ahead of time
+  void prefetch(int64_t position) const {
+    if(compressed){
+      int64_t block = position / RRR_BLOCK_BITS;
+      __builtin_prefetch(&rrr_samples[2 * (block / RRR_SAMPLE_BLOCKS)]);
+      __builtin_prefetch(&rrr_classes[block / RRR_CLASSES_PER_WORD]);
+      return;
+    }
+    __builtin_prefetch(&block_ranks[position / BLOCK_BITS]);
+    __builtin_prefetch(&words[position >> 6]);
+  }
+
+  // Number of ones before the given block
+  int64_t block_rank(int64_t block) const {
+    return superblock_ranks[block * BLOCK_BITS / SUPERBLOCK_BITS] + block_ranks[block];
+  }
+
+  // Requires init_rank_support() to have been called first
+  void init_select_support(){
+    int64_t n_blocks = block_ranks.size() - 1;
+    select_samples.clear();
+    for(int64_t b = 0; b < n_blocks; b++)
+      while((int64_t)select_samples.size() * SELECT_SAMPLE < block_rank(b + 1))
+        select_samples.push_back(b); // Block b contains the (size*SELECT_SAMPLE+1)-th one
+    select_samples.push_back(n_blocks > 0 ? n_blocks - 1 : 0); // Sentinel
+  }
+
+  // Returns the position of the count-th one (1-based)
+  int64_t select1(int64_t count) const {
+    BOSS_COUNT(select_calls);
+    if(compressed){
+      RRRVector R = rrr();
+      return RRR_Select(&R, '1', count);
+    }
+    int64_t lo = select_samples[(count - 1) / SELECT_SAMPLE];
+    int64_t hi = select_samples[(count - 1) / SELECT_SAMPLE + 1];
+    while(lo < hi){ // Last block with fewer than count ones before it
+      int64_t mid = lo + (hi - lo + 1) / 2;
+      if(block_rank(mid) < count) lo = mid;
+      else hi = mid - 1;
+    }
+    const uint64_t* planes[1] = {words.data()};
+    return match_select(planes, 1, 1, 1, lo * 8, count - block_rank(lo));
+  }
+
+  // Replaces the plain representation with the RRR one. Select support is included.
+  void compress(){
+    if(compressed) return;
+    RRRVector R = RRR_from_words(words.data(), n_bits);
+    n_ones = R.n_ones;
+    rrr_classes.resize(R.n_class_words);
+    rrr_offsets.resize(R.n_offset_words);
+    rrr_samples.resize(2 * R.n_samples);
+    std::copy(R.classes, R.classes + R.n_class_words, &rrr_classes[0]);
+    std::copy(R.offsets, R.offsets + R.n_offset_words, &rrr_offsets[0]);
+    std::copy(R.samples, R.samples + 2 * R.n_samples, &rrr_samples[0]);
+    RRR_free(&R);
+    words.clear();
+    superblock_ranks.clear();
+    block_ranks.clear();
+    select_samples.clear();
+    compressed = true;
+  }
+
+  int64_t size_in_bytes() const {
+    return 8 * (words.size() + superblock_ranks.size() + select_samples.size() + rrr_classes.size() + rrr_offsets.size() + rrr_samples.size())
+           + 2 * block_ranks.size();
+  }
+
+  void serialize(IndexWriter& out) const {
+    out.write_scalar(compressed);
+    if(compressed){ // Same layout as RRR_write
+      out.write_scalar(n_bits);
+      out.write_scalar(n_ones);
+      out.write_array(rrr_classes);
+      out.write_array(rrr_offsets);
+      out.write_array(rrr_samples);
+      return;
+    }
+    out.write_scalar(n_bits);
+    out.write_array(words);
+    out.write_array(superblock_ranks);
+    out.write_array(block_ranks);
+    out.write_array(select_samples);
+  }
+
+  // The arrays point into the mapping of the reader
+  static BitVector load(IndexReader& in){
+    BitVector B;
+    B.compressed = in.read_scalar() != 0;
+    if(B.compressed){
+      B.n_bits = in.read_scalar();
+      B.n_ones = in.read_scalar();
+      B.rrr_classes = in.read_array<uint64_t>();
+      B.rrr_offsets = in.read_array<uint64_t>();
+      B.rrr_samples = in.read_array<int64_t>();
+      return B;
+    }
+    B.n_bits = in.read_scalar();
+    B.words = in.read_array<uint64_t>();
+    B.superblock_ranks = in.read_array<uint64_t>();
+    B.block_ranks = in.read_array<uint16_t>();
+    B.select_samples = in.read_array<int64_t>();
+    return B;
+  }
+
+  // View of the RRR arrays for the functions in rrr_vector.h
+  RRRVector rrr() const {
+    RRRVector R;
+    R.classes = rrr_classes.data();
+    R.offsets = rrr_offsets.data();
+    R.samples = rrr_samples.data();
+    R.n_bits = n_bits;
+    R.n_ones = n_ones;
+    R.n_blocks = n_bits / RRR_BLOCK_BITS + 1;
+    R.n_class_words = rrr_classes.size();
+    R.n_offset_words = rrr_offsets.size();
+    R.n_samples = rrr_samples.size() / 2;
+    return R;
+  }
+
+  string to_string() const {
+    string S(n_bits, '0');
+    for(int64_t i = 0; i < n_bits; i++)
+      if((*this)[i]) S[i] = '1';
+    return S;
+  }
+};
+
+// Unsigned integers of `width` bits (at most 63) packed into words. Integer i occupies
+// bits [i*width, (i+1)*width), so ranges that start at multiples of 64 integers never
+// share a word and can be filled by separate threads.
+class IntVector{
+public:
+  Array<uint64_t> words;
+  int64_t n = 0;
+  int width = 0;
+
+  IntVector() {}
+  IntVector(int64_t size, int width) : words((size * width + 63) / 64 + 1), n(size), width(width) {}
+
+  int64_t size() const { return n; }
+
+  int64_t operator[](int64_t i) const {
+    int64_t bit = i * width, offset = bit & 63;
+    uint64_t x = words[bit >> 6] >> offset;
+    if(offset + width > 64) x |= words[(bit >> 6) + 1] << (64 - offset);
+    return x & ((uint64_t(1) << width) - 1);
+  }
+
+  // Integer i must still be zero
+  void set(int64_t i, uint64_t x){
+    int64_t bit = i * width, offset = bit & 63;
+    words[bit >> 6] |= x << offset;
+    if(offset + width > 64) words[(bit >> 6) + 1] |= x >> (64 - offset);
+  }
+
+  int64_t size_in_bytes() const { return 8 * words.size(); }
+
+  void serialize(IndexWriter& out) const {
+    out.write_scalar(n);
+    out.write_scalar(width);
+    out.write_array(words);
+  }
+
+  // The words point into the mapping of the reader
+  static IntVector load(IndexReader& in){
+    IntVector V;
+    V.n = in.read_scalar();
+    V.width = in.read_scalar();
+    V.words = in.read_array<uint64_t>();
+    return V;
+  }
+};
+
+inline ostream& operator<<(ostream& os, const BitVector& B){
+  return os << B.to_string();
+}
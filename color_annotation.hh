@@ -0,0 +1,303 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include "select_free_boss.hh"
+#include "serialization.hh"
+
+using std::string;
+using std::vector;
+
+// Sorted colors of one color set. Points into the set table of a ColorAnnotation.
+struct ColorSet{
+  const int32_t* first = nullptr;
+  const int32_t* last = nullptr;
+
+  const int32_t* begin() const { return first; }
+  const int32_t* end() const { return last; }
+  int64_t size() const { return last - first; }
+  bool empty() const { return first == last; }
+  int32_t operator[](int64_t i) const { return first[i]; }
+};
+
+// Colors of the nodes of a SelectFreeBOSS. Each input sequence (or file, or sample) has a
+// color, and a k-mer has the set of colors of the sequences that contain it. Most k-mers
+// share their set with many others, so the distinct sets are stored once, as sorted color
+// lists concatenated in set_colors with boundaries in set_offsets, and each node stores
+// only the id of its set, bit-packed with just enough bits for the number of sets. The
+// nodes are indexed by colex rank, so the rank that search() returns leads directly to the
+// set. Set 0 is the empty set of the dummies, the root and the nodes that no colored
+// sequence reached.
+class ColorAnnotation{
+public:
+  // Gives every k-mer of sequences[i] the color colors[i] (non-negative). The k-mers of the
+  // sequences must be in the index; the others are skipped. If the index has both strands,
+  // the reverse complements get the same colors.
+  ColorAnnotation(const SelectFreeBOSS& boss, const vector<string>& sequences, const vector<int32_t>& colors, int n_threads = 1);
+  // Gives the i-th record of the file color i and names it by its header up to the first
+  // whitespace. Reads records in batches of about batch_bases characters. Besides one
+  // batch, the construction keeps a set id per node and the table of the sets in use.
+  ColorAnnotation(const SelectFreeBOSS& boss, SequenceReader& input, int n_threads = 1, int64_t batch_bases = 1 << 28);
+
+  int64_t n_nodes = 0;
+  int64_t n_colors = 0; // Colors are 0..n_colors-1
+  int64_t n_sets = 0; // Distinct color sets, including the empty set 0
+  int64_t id_bits = 1; // Bits per set id
+  Array<uint64_t> set_ids; // Set id of each node, id_bits each
+  Array<int64_t> set_offsets; // The colors of set s are set_colors[set_offsets[s]..set_offsets[s+1])
+  Array<int32_t> set_colors;
+  Array<char> names; // Optional color names, concatenated
+  Array<int64_t> name_offsets; // Empty or n_colors + 1 boundaries in names
+
+  int64_t set_id(int64_t node) const {
+    int64_t bit = node * id_bits;
+    int64_t word = bit >> 6, offset = bit & 63;
+    uint64_t x = set_ids[word] >> offset;
+    if(offset + id_bits > 64) x |= set_ids[word + 1] << (64 - offset);
+    return x & ((uint64_t(1) << id_bits) - 1);
+  }
+
+  ColorSet color_set(int64_t id) const {
+    return {set_colors.data() + set_offsets[id], set_colors.data() + set_offsets[id + 1]};
+  }
+
+  ColorSet node_colors(int64_t node) const { return color_set(set_id(node)); }
+
+  // The name of the color, or its number if the colors have no names
+  string color_name(int32_t color) const {
+    if(name_offsets.size() == 0) return std::to_string(color);
+    return string(names.data() + name_offsets[color], names.data() + name_offsets[color + 1]);
+  }
+
+  // Writes the annotation to a binary index file
+  void save(const string& filename) const;
+  // Maps an annotation file into memory and queries it in place
+  static ColorAnnotation load(const string& filename);
+
+  void add_to_stats(IndexStats& stats) const {
+    stats.add("color set ids", sizeof(uint64_t) * set_ids.size());
+    stats.add("color sets", sizeof(int64_t) * set_offsets.size() + sizeof(int32_t) * set_colors.size());
+    stats.add("color names", names.size() + sizeof(int64_t) * name_offsets.size());
+  }
+
+private:
+  // Distinct color sets under construction, with ids in order of insertion. Set 0 is empty.
+  struct SetTable{
+    struct SetHash{
+      size_t operator()(const vector<int32_t>& S) const {
+        uint64_t h = S.size();
+        for(int32_t x : S) h = (h ^ uint32_t(x)) * 0x9E3779B97F4A7C15ULL;
+        return h ^ (h >> 29);
+      }
+    };
+    std::unordered_map<vector<int32_t>, int64_t, SetHash> index;
+    vector<int64_t> offsets = {0, 0};
+    vector<int32_t> colors;
+
+    int64_t size() const { return offsets.size() - 1; }
+    int64_t insert(const vector<int32_t>& S);
+    // Keeps only the sets in ids, renumbered in order of first use
+    void compact(vector<int64_t>& ids);
+  };
+
+  ColorAnnotation() {}
+  // Sorted distinct (node << color_bits | color) pairs. The colors must be below 2^color_bits.
+  static vector<uint64_t> color_pairs(const SelectFreeBOSS& boss, const vector<string>& sequences, const vector<int32_t>& colors,
+                                      int color_bits, int n_threads);
+  // Gives every node in the pairs the union of its set and its colors in the pairs
+  static void add_colors(const vector<uint64_t>& pairs, int color_bits, vector<int64_t>& ids, SetTable& table);
+  // Bits for the colors 0..n_colors-1 in a pair. Throws if the nodes do not fit in the rest.
+  static int pair_color_bits(const SelectFreeBOSS& boss, int64_t n_colors);
+  // Packs the set ids and the set table into the annotation
+  void build(const vector<int64_t>& ids, const SetTable& table);
+  std::shared_ptr<const void> mapping; // Keeps a loaded annotation file mapped
+};
+
+inline int64_t ColorAnnotation::SetTable::insert(const vector<int32_t>& S){
+  if(S.empty()) return 0;
+  auto inserted = index.emplace(S, size());
+  if(inserted.second){
+    colors.insert(colors.end(), S.begin(), S.end());
+    offsets.push_back(colors.size());
+  }
+  return inserted.first->second;
+}
+
+inline void ColorAnnotation::SetTable::compact(vector<int64_t>& ids){
+  SetTable kept;
+  vector<int64_t> new_ids(size(), -1);
+  vector<int32_t> S;
+  for(int64_t& id : ids){
+    if(new_ids[id] < 0){
+      S.assign(colors.begin() + offsets[id], colors.begin() + offsets[id + 1]);
+      new_ids[id] = kept.insert(S);
+    }
+    id = new_ids[id];
+  }
+  std::swap(*this, kept);
+}
+
+inline int ColorAnnotation::pair_color_bits(const SelectFreeBOSS& boss, int64_t n_colors){
+  int color_bits = 1;
+  while((int64_t(1) << color_bits) < n_colors) color_bits++;
+  if(boss.node_count > 0 && ((uint64_t)(boss.node_count - 1) >> (64 - color_bits)) != 0)
+    throw std::invalid_argument(std::to_string(boss.node_count) + " nodes and " + std::to_string(n_colors) + " colors do not fit in 64-bit pairs");
+  return color_bits;
+}
+
+// Each thread walks its share of the sequences with streaming_search, which finds the
+// ranks of all k-mers of a sequence in about one search step per character.
+inline vector<uint64_t> ColorAnnotation::color_pairs(const SelectFreeBOSS& boss, const vector<string>& sequences,
+                                                     const vector<int32_t>& colors, int color_bits, int n_threads){
+  n_threads = std::max(n_threads, 1);
+  vector<int64_t> ranges = split_range(sequences.size(), n_threads);
+  vector<vector<uint64_t>> thread_pairs(n_threads);
+  parallel_for(n_threads, n_threads, [&](int64_t t){
+    vector<uint64_t>& pairs = thread_pairs[t];
+    auto add = [&](const vector<int64_t>& ranks, int32_t color){
+      for(int64_t rank : ranks)
+        if(rank >= 0) pairs.push_back(uint64_t(rank) << color_bits | uint32_t(color));
+    };
+    for(int64_t i = ranges[t]; i < ranges[t+1]; i++){
+      add(streaming_search(boss, sequences[i]), colors[i]);
+      if(boss.both_strands) add(streaming_search(boss, reverse_complement(sequences[i])), colors[i]);
+    }
+    std::sort(pairs.begin(), pairs.end());
+    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+  });
+
+  vector<uint64_t> pairs;
+  for(vector<uint64_t>& part : thread_pairs){
+    int64_t middle = pairs.size();
+    pairs.insert(pairs.end(), part.begin(), part.end());
+    vector<uint64_t>().swap(part);
+    std::inplace_merge(pairs.begin(), pairs.begin() + middle, pairs.end());
+  }
+  pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+  return pairs;
+}
+
+// The pairs are sorted by node, so the colors of each node are a sorted run
+inline void ColorAnnotation::add_colors(const vector<uint64_t>& pairs, int color_bits, vector<int64_t>& ids, SetTable& table){
+  uint64_t color_mask = (uint64_t(1) << color_bits) - 1;
+  vector<int32_t> added, merged;
+  for(int64_t i = 0; i < (int64_t)pairs.size();){
+    int64_t node = pairs[i] >> color_bits;
+    added.clear();
+    for(; i < (int64_t)pairs.size() && int64_t(pairs[i] >> color_bits) == node; i++) added.push_back(int32_t(pairs[i] & color_mask));
+    const int32_t* old_colors = table.colors.data();
+    merged.clear();
+    std::set_union(old_colors + table.offsets[ids[node]], old_colors + table.offsets[ids[node] + 1],
+                   added.begin(), added.end(), std::back_inserter(merged));
+    ids[node] = table.insert(merged);
+  }
+}
+
+inline void ColorAnnotation::build(const vector<int64_t>& ids, const SetTable& table){
+  const vector<int64_t>& offsets = table.offsets;
+  const vector<int32_t>& colors = table.colors;
+  n_nodes = ids.size();
+  n_sets = table.size();
+  id_bits = 1;
+  while((int64_t(1) << id_bits) < n_sets) id_bits++;
+  set_ids.assign((n_nodes * id_bits + 63) / 64 + 1, 0);
+  for(int64_t node = 0; node < n_nodes; node++){
+    int64_t bit = node * id_bits;
+    uint64_t id = ids[node];
+    set_ids[bit >> 6] |= id << (bit & 63);
+    if((bit & 63) + id_bits > 64) set_ids[(bit >> 6) + 1] |= id >> (64 - (bit & 63));
+  }
+  set_offsets = Array<int64_t>(offsets.size());
+  std::copy(offsets.begin(), offsets.end(), &set_offsets[0]);
+  set_colors = Array<int32_t>(colors.size());
+  std::copy(colors.begin(), colors.end(), &set_colors[0]);
+}
+
+inline ColorAnnotation::ColorAnnotation(const SelectFreeBOSS& boss, const vector<string>& sequences, const vector<int32_t>& colors,
+                                        int n_threads){
+  if(sequences.size() != colors.size()) throw std::invalid_argument("Every sequence needs a color");
+  for(int32_t color : colors){
+    if(color < 0) throw std::invalid_argument("Colors must be non-negative");
+    n_colors = std::max<int64_t>(n_colors, color + 1);
+  }
+  vector<int64_t> ids(boss.node_count, 0);
+  SetTable table;
+  int color_bits = pair_color_bits(boss, n_colors);
+  add_colors(color_pairs(boss, sequences, colors, color_bits, n_threads), color_bits, ids, table);
+  build(ids, table);
+}
+
+// Only one batch of pairs is in memory at a time. After each batch, the sets that no node
+// uses any more are dropped from the table.
+inline ColorAnnotation::ColorAnnotation(const SelectFreeBOSS& boss, SequenceReader& input, int n_threads, int64_t batch_bases){
+  vector<int64_t> ids(boss.node_count, 0);
+  SetTable table;
+  vector<string> batch;
+  vector<int32_t> colors;
+  vector<int64_t> offsets = {0};
+  string header, sequence, all_names;
+  bool more = true;
+  while(more){
+    batch.clear();
+    colors.clear();
+    int64_t bases = 0;
+    while(bases < batch_bases && (more = input.next_read(header, sequence))){
+      for(char& c : sequence) c = toupper(c);
+      bases += sequence.size();
+      batch.push_back(std::move(sequence));
+      colors.push_back(n_colors++);
+      all_names += header.substr(0, header.find_first_of(" \t"));
+      offsets.push_back(all_names.size());
+    }
+    if(batch.empty()) break;
+    int color_bits = pair_color_bits(boss, n_colors);
+    add_colors(color_pairs(boss, batch, colors, color_bits, n_threads), color_bits, ids, table);
+    table.compact(ids);
+  }
+  build(ids, table);
+  names = Array<char>(all_names.size());
+  std::copy(all_names.begin(), all_names.end(), &names[0]);
+  name_offsets = Array<int64_t>(offsets.size());
+  std::copy(offsets.begin(), offsets.end(), &name_offsets[0]);
+}
+
+inline void ColorAnnotation::save(const string& filename) const {
+  IndexWriter out(filename, INDEX_COLOR_ANNOTATION);
+  out.write_scalar(n_nodes);
+  out.write_scalar(n_colors);
+  out.write_scalar(n_sets);
+  out.write_scalar(id_bits);
+  out.write_array(set_ids);
+  out.write_array(set_offsets);
+  out.write_array(set_colors);
+  out.write_array(names);
+  out.write_array(name_offsets);
+  out.close();
+}
+
+inline ColorAnnotation ColorAnnotation::load(const string& filename){
+  IndexReader in(filename, INDEX_COLOR_ANNOTATION);
+  ColorAnnotation annotation;
+  annotation.n_nodes = in.read_scalar();
+  annotation.n_colors = in.read_scalar();
+  annotation.n_sets = in.read_scalar();
+  annotation.id_bits = in.read_scalar();
+  annotation.set_ids = in.read_array<uint64_t>();
+  annotation.set_offsets = in.read_array<int64_t>();
+  annotation.set_colors = in.read_array<int32_t>();
+  annotation.names = in.read_array<char>();
+  annotation.name_offsets = in.read_array<int64_t>();
+  annotation.mapping = in.mapping();
+  return annotation;
+}
+
+// Colors of the k-mer: empty if it is not in the index
+inline ColorSet search_colors(const SelectFreeBOSS& boss, const ColorAnnotation& annotation, const string& kmer){
+  int64_t rank = search(boss, kmer);
+  return rank >= 0 ? annotation.node_colors(rank) : ColorSet();
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+#include <iterator>
+#include "select_free_boss.hh"
+
+using std::string;
+using std::vector;
+
+// Keys and label lengths of all nodes of the structure in colex order, dummies and root
+// included. Every node except the root is the target of exactly one unmarked edge, and
+// the edges with character c reach the nodes that end in c in node order. The label of a
+// node is the label of that predecessor shifted by one character, so k rounds over all
+// nodes recover every label.
+template <typename kmer_t>
+void extract_labels(const SelectFreeBOSS& boss, vector<kmer_t>& keys, vector<uint8_t>& lengths, int n_threads = 1){
+  int64_t n = boss.node_count;
+  int k = boss.k;
+  vector<int64_t> predecessor(n);
+  vector<uint8_t> last(n); // 2-bit code of the last character
+  int64_t next[4];
+  for(int c = 0; c < 4; c++) next[c] = boss.C["ACGT"[c]];
+  for(int64_t u = 0; u < n; u++){
+    uint8_t out = boss.out_edges(u);
+    for(int c = 0; c < 4; c++){
+      if(((out >> c) & 1) == 0) continue;
+      predecessor[next[c]] = u;
+      last[next[c]++] = c;
+    }
+  }
+
+  keys.assign(n, 0);
+  lengths.assign(n, 0);
+  vector<kmer_t> next_keys(n);
+  vector<uint8_t> next_lengths(n);
+  vector<int64_t> ranges = split_range(n, n_threads);
+  for(int round = 0; round < k; round++){
+    parallel_for(n_threads, n_threads, [&](int64_t t){
+      for(int64_t v = std::max<int64_t>(ranges[t], 1); v < ranges[t+1]; v++){ // The root stays empty
+        next_keys[v] = (keys[predecessor[v]] >> 2) | (kmer_t(last[v]) << (2*(k-1)));
+        next_lengths[v] = std::min(lengths[predecessor[v]] + 1, k);
+      }
+    });
+    keys.swap(next_keys);
+    lengths.swap(next_lengths);
+  }
+}
+
+// Keys of the k-mers of the structure in colex order, without the dummies
+template <typename kmer_t>
+vector<kmer_t> extract_kmer_keys(const SelectFreeBOSS& boss, int n_threads = 1){
+  vector<kmer_t> keys;
+  vector<uint8_t> lengths;
+  extract_labels(boss, keys, lengths, n_threads);
+  int64_t out = 0;
+  for(int64_t v = 0; v < boss.node_count; v++)
+    if(lengths[v] == boss.k) keys[out++] = keys[v];
+  keys.resize(out);
+  return keys;
+}
+
+// SelectFreeBOSS with insertions and deletions. Updates go to a hash buffer that every
+// query consults before the static index. When the buffer reaches merge_threshold
+// updates, a background thread extracts the k-mers of the static index, applies the
+// buffered updates and builds a new index with node_list_from_kmers, while queries and
+// updates continue against the old index and a fresh buffer. The new index replaces the
+// old one atomically. Its colex ranks differ from the old ones, so queries answer
+// membership only. Queries are safe to run from many threads at once with updates. If
+// the index has both strands, every update applies to the reverse complement as well.
+//
+// The rebuild sees only the k-mers, so node_list_from_kmers adds an edge between every
+// two k-mers that overlap by k-1 characters. An index built from sequences has only the
+// edges of their (k+1)-mers, so after a merge the graph can have edges that the original
+// index did not have, which changes outdegree, forward steps and unitigs of static_index().
+// Membership answers do not depend on the edges.
+//
+// Only SelectFreeBOSS is supported. A WheelerBOSS could be rebuilt from the same node list
+// with construct_wheeler_boss, but it is a C struct that does not store k or the strand
+// flag and whose arrays are released by hand with WheelerBOSS_free or WheelerBOSS_unload,
+// so sharing old indexes with queries in flight through shared_ptr would need an owning
+// wrapper. Its k-mers would also need an extraction over the I and O bit vectors in place
+// of extract_labels.
+class DynamicBOSS{
+public:
+  DynamicBOSS(SelectFreeBOSS index, int64_t merge_threshold = 1 << 20, int n_threads = 1)
+    : index(std::make_shared<SelectFreeBOSS>(std::move(index))), merge_threshold(std::max<int64_t>(merge_threshold, 1)),
+      n_threads(std::max(n_threads, 1)) {}
+
+  ~DynamicBOSS(){
+    if(merger.joinable()) merger.join();
+  }
+
+  // Throw std::invalid_argument if the k-mer has the wrong length or characters other than A, C, G, T
+  void insert(const string& kmer){ update(kmer, true); }
+  void erase(const string& kmer){ update(kmer, false); }
+
+  bool contains(const string& kmer) const {
+    std::shared_ptr<const SelectFreeBOSS> current;
+    {
+      std::shared_lock<std::shared_mutex> lock(mutex);
+      auto it = buffer.find(kmer);
+      if(it != buffer.end()) return it->second;
+      if(merging != nullptr && (it = merging->find(kmer)) != merging->end()) return it->second;
+      current = index;
+    }
+    return search(*current, kmer) >= 0;
+  }
+
+  // Starts folding the buffer into the static index in the background, unless a merge is
+  // already running or the buffer is empty
+  void merge(){
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    start_merge();
+  }
+
+  // Waits for the running merge. Rethrows its exception, if it failed.
+  void wait(){
+    std::thread finished;
+    std::exception_ptr error;
+    {
+      std::unique_lock<std::shared_mutex> lock(mutex);
+      finished.swap(merger);
+      std::swap(error, merge_error);
+    }
+    if(finished.joinable()) finished.join();
+    if(error) std::rethrow_exception(error);
+  }
+
+  // The current static index. It stays valid after later merges replace it.
+  std::shared_ptr<const SelectFreeBOSS> static_index() const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return index;
+  }
+
+  // Number of updates that are not in the static index yet
+  int64_t buffered() const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return buffer.size() + (merging != nullptr ? merging->size() : 0);
+  }
+
+private:
+  typedef std::unordered_map<string, bool> Buffer; // K-mer -> inserted (true) or deleted (false)
+
+  mutable std::shared_mutex mutex;
+  std::shared_ptr<const SelectFreeBOSS> index;
+  Buffer buffer; // Updates since the running merge started
+  std::shared_ptr<const Buffer> merging; // Updates that the running merge is folding in
+  std::thread merger;
+  std::exception_ptr merge_error;
+  int64_t merge_threshold;
+  int n_threads;
+
+  void update(const string& kmer, bool present){
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    if((int64_t)kmer.size() != index->k)
+      throw std::invalid_argument("K-mer " + kmer + " does not have length " + std::to_string(index->k));
+    for(char c : kmer)
+      if(nucleotide_code(c) < 0) throw std::invalid_argument("Invalid character in k-mer " + kmer);
+    buffer[kmer] = present;
+    if(index->both_strands) buffer[reverse_complement(kmer)] = present;
+    if((int64_t)buffer.size() >= merge_threshold) start_merge();
+  }
+
+  // Requires the lock
+  void start_merge(){
+    if(merging != nullptr || buffer.empty()) return;
+    if(merger.joinable()) merger.join(); // Finished: it released the lock after its last step
+    merging = std::make_shared<const Buffer>(std::move(buffer));
+    buffer.clear();
+    merger = std::thread([this, old_index = index, updates = merging](){
+      try{
+        std::shared_ptr<const SelectFreeBOSS> merged_index = old_index->k <= 32
+          ? merged<uint64_t>(*old_index, *updates, n_threads) : merged<__uint128_t>(*old_index, *updates, n_threads);
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        index = merged_index;
+        merging.reset();
+      } catch(...){
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        for(const auto& update : *updates) buffer.insert(update); // Keeps the newer updates
+        merging.reset();
+        merge_error = std::current_exception();
+      }
+    });
+  }
+
+  template <typename kmer_t>
+  static std::shared_ptr<const SelectFreeBOSS> merged(const SelectFreeBOSS& old_index, const Buffer& updates, int n_threads){
+    int k = old_index.k;
+    vector<kmer_t> inserted, deleted;
+    for(const auto& update : updates)
+      (update.second ? inserted : deleted).push_back(encode_kmer<kmer_t>(update.first));
+    std::sort(inserted.begin(), inserted.end());
+    std::sort(deleted.begin(), deleted.end());
+
+    vector<kmer_t> kept, kmers;
+    vector<kmer_t> old_kmers = extract_kmer_keys<kmer_t>(old_index, n_threads);
+    std::set_difference(old_kmers.begin(), old_kmers.end(), deleted.begin(), deleted.end(), std::back_inserter(kept));
+    vector<kmer_t>().swap(old_kmers);
+    std::set_union(kept.begin(), kept.end(), inserted.begin(), inserted.end(), std::back_inserter(kmers));
+    vector<kmer_t>().swap(kept);
+
+    auto boss = std::make_shared<SelectFreeBOSS>(SelectFreeBOSS::from_node_list(node_list_from_kmers(kmers, k, n_threads), k, n_threads, false, old_index.has_lcs()));
+    boss->both_strands = old_index.both_strands;
+    if(old_index.layout != SelectFreeBOSS::SPLIT) boss->set_layout(old_index.layout);
+    if(old_index.prefix_length > 0) boss->build_prefix_table(old_index.prefix_length, n_threads);
+    return boss;
+  }
+};
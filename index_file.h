@@ -0,0 +1,130 @@
+#pragma once
+
+#include "inttypes.h"
+#include "stdio.h"
+#include "string.h"
+#include "fcntl.h"
+#include "unistd.h"
+#include "sys/mman.h"
+#include "sys/stat.h"
+
+// Binary index file container shared by all structures in this repository.
+// Written in the common subset of C and C++.
+//
+// Layout: a 16-byte header (magic, version, structure type) followed by fields.
+// A scalar field is 8 bytes. An array field is its byte length as 8 bytes,
+// padding up to a multiple of INDEX_ALIGNMENT, the data, and padding up to a
+// multiple of 8. All data is little-endian as in memory, so a loader can mmap
+// the file and point directly into it.
+
+#define INDEX_MAGIC "BOSSIDX"
+#define INDEX_VERSION 8
+#define INDEX_ALIGNMENT 64
+
+#define INDEX_SELECT_FREE_BOSS 1
+#define INDEX_BOSS 2
+#define INDEX_WHEELER_BOSS 3
+#define INDEX_COLOR_ANNOTATION 4
+
+typedef struct IndexHeader{
+
+    char magic[8];
+    uint32_t version;
+    uint32_t type;
+
+} IndexHeader;
+
+static inline void index_write_padding(FILE* f, int64_t alignment){
+    char zeros[INDEX_ALIGNMENT] = {0};
+    int64_t offset = ftell(f);
+    if(offset % alignment != 0) fwrite(zeros, 1, alignment - offset % alignment, f);
+}
+
+static inline void index_write_header(FILE* f, uint32_t type){
+    IndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header.version = INDEX_VERSION;
+    header.type = type;
+    fwrite(&header, sizeof(header), 1, f);
+}
+
+static inline void index_write_scalar(FILE* f, int64_t x){
+    fwrite(&x, sizeof(x), 1, f);
+}
+
+static inline void index_write_array(FILE* f, const void* data, int64_t n_bytes){
+    index_write_scalar(f, n_bytes);
+    index_write_padding(f, INDEX_ALIGNMENT);
+    if(n_bytes > 0) fwrite(data, 1, n_bytes, f);
+    index_write_padding(f, 8);
+}
+
+// A read-only memory mapping of an index file with a read cursor
+typedef struct IndexFile{
+
+    const char* base;
+    int64_t size;
+    int64_t pos;
+    int error; // Set if a read went past the end of the file
+
+} IndexFile;
+
+// Maps the file and checks the header. Returns NULL on success and an error message otherwise.
+static inline const char* index_map(IndexFile* file, const char* filename, uint32_t type){
+    file->base = NULL;
+    file->size = 0;
+    file->pos = sizeof(IndexHeader);
+    file->error = 0;
+
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0) return "could not open index file";
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < (int64_t)sizeof(IndexHeader)){
+        close(fd);
+        return "index file is too small";
+    }
+    void* base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(base == MAP_FAILED) return "could not mmap index file";
+    file->base = (const char*)base;
+    file->size = st.st_size;
+
+    const IndexHeader* header = (const IndexHeader*)base;
+    const char* error = NULL;
+    if(memcmp(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0) error = "not an index file";
+    else if(header->version != INDEX_VERSION) error = "unsupported index file version";
+    else if(header->type != type) error = "index file contains a different structure";
+    if(error != NULL){
+        munmap((void*)file->base, file->size);
+        file->base = NULL;
+    }
+    return error;
+}
+
+static inline void index_unmap(IndexFile* file){
+    if(file->base != NULL) munmap((void*)file->base, file->size);
+    file->base = NULL;
+}
+
+static inline int64_t index_read_scalar(IndexFile* file){
+    int64_t x = 0;
+    if(file->pos + 8 > file->size) file->error = 1;
+    else memcpy(&x, file->base + file->pos, 8);
+    file->pos += 8;
+    return x;
+}
+
+// Returns a pointer to the array data inside the mapping
+static inline const void* index_read_array(IndexFile* file, int64_t* n_bytes){
+    *n_bytes = index_read_scalar(file);
+    file->pos = (file->pos + INDEX_ALIGNMENT - 1) / INDEX_ALIGNMENT * INDEX_ALIGNMENT;
+    const void* data = file->base + file->pos;
+    if(*n_bytes < 0 || file->pos + *n_bytes > file->size){
+        file->error = 1;
+        *n_bytes = 0;
+        return NULL;
+    }
+    file->pos = (file->pos + *n_bytes + 7) / 8 * 8;
+    return data;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <utility>
+#include <iostream>
+#include "bit_vector.hh"
+#include "rank_select.h"
+
+using std::string;
+using std::vector;
+using std::ostream;
+
+// Sizes and counts of a built structure, from index_stats() of each structure
+struct IndexStats{
+  string structure;
+  int64_t k = 0;
+  int64_t n_nodes = 0; // Including the root and the dummies
+  int64_t n_edges = 0; // Stored edges
+  int64_t n_dummies = 0; // Nodes whose label starts with a dollar, not counting the root
+  vector<std::pair<string, int64_t>> components; // Name and size in bytes of each part of the structure
+
+  int64_t n_kmers() const { return std::max<int64_t>(n_nodes - n_dummies - 1, 0); }
+
+  int64_t total_bytes() const {
+    int64_t total = 0;
+    for(const auto& component : components) total += component.second;
+    return total;
+  }
+
+  double bits_per_kmer() const { return n_kmers() > 0 ? 8.0 * total_bytes() / n_kmers() : 0; }
+
+  void add(const string& name, int64_t bytes){
+    if(bytes > 0) components.push_back({name, bytes});
+  }
+
+  // The bits, the rank directory and the select samples as separate components
+  void add(const string& name, const BitVector& B){
+    if(B.compressed){
+      add(name + " RRR classes and offsets", 8 * (B.rrr_classes.size() + B.rrr_offsets.size()));
+      add(name + " RRR samples", 8 * B.rrr_samples.size());
+      return;
+    }
+    add(name + " bits", 8 * B.words.size());
+    add(name + " rank directory", 8 * B.superblock_ranks.size() + 2 * B.block_ranks.size());
+    add(name + " select samples", 8 * B.select_samples.size());
+  }
+
+  void add(const string& name, const PackedBitVector& B){
+    if(B.compressed){
+      add(name + " RRR classes and offsets", 8 * (B.rrr.n_class_words + B.rrr.n_offset_words));
+      add(name + " RRR samples", 16 * B.rrr.n_samples);
+      return;
+    }
+    int64_t bits = 8 * (B.n_blocks * (PACKED_BLOCK_BITS / 64) + 1);
+    int64_t rank_directory = 8 * (B.n_blocks + 1);
+    add(name + " bits", bits);
+    add(name + " rank directory", rank_directory);
+    add(name + " select samples", PackedBitVector_size_in_bytes(&B) - bits - rank_directory);
+  }
+
+  void add(const string& name, const PackedDNA& P){
+    int64_t n_blocks = P.length / PACKED_BLOCK_BITS + 1;
+    add(name + " bits", 2 * 8 * n_blocks * (PACKED_BLOCK_BITS / 64));
+    add(name + " rank directory", 8 * 4 * (n_blocks + 1));
+  }
+};
+
+// Tab-separated lines of names and values
+inline ostream& operator<<(ostream& out, const IndexStats& stats){
+  out << "structure\t" << stats.structure << '\n';
+  out << "k\t" << stats.k << '\n';
+  out << "nodes\t" << stats.n_nodes << '\n';
+  out << "edges\t" << stats.n_edges << '\n';
+  out << "k-mers\t" << stats.n_kmers() << '\n';
+  out << "dummies\t" << stats.n_dummies << '\n';
+  for(const auto& component : stats.components) out << "bytes: " << component.first << '\t' << component.second << '\n';
+  out << "bytes\t" << stats.total_bytes() << '\n';
+  out << "bits per k-mer\t" << stats.bits_per_kmer() << '\n';
+  return out;
+}
+
+// Number of dummy nodes, which are the nodes reached from the root (node 0) in 1 to k-1
+// steps. A dummy $^{k-i}X has a single in-edge, from $^{k-i+1}X[0..i-1), so the walk
+// reaches each of them once. successors(u, out) appends the targets of the out-edges of u.
+template <typename Successors>
+int64_t count_dummies(int64_t n_nodes, int64_t k, const Successors& successors){
+  if(n_nodes == 0) return 0;
+  int64_t count = 0;
+  vector<int64_t> level = {0}, next;
+  for(int64_t depth = 1; depth < k && !level.empty(); depth++){
+    next.clear();
+    for(int64_t u : level) successors(u, next);
+    count += next.size();
+    level.swap(next);
+  }
+  return count;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "serialization.hh"
+#include "popcount.h"
+#include "query_counters.h"
+
+using std::vector;
+
+// The four SBWT bit vectors interleaved so that rank for any character reads a single
+// cache line. Each 64-byte line covers 96 positions: the numbers of A, C, G and T before
+// the line, then the out-edge sets of its positions as 4-bit masks, 16 per word, with
+// bit c of a mask set for the character with code c. A rank query is one lookup and at
+// most 6 popcounts, and the queries for all four characters at a position share the line.
+// The counts of a line are 32-bit and start over every SUPERBLOCK_LINES lines; the 64-bit
+// counts before each superblock are in a small separate array that stays in the cache.
+class InterleavedSBWT{
+public:
+  static const int64_t LINE_POSITIONS = 96;
+  static const int64_t SUPERBLOCK_LINES = int64_t(1) << 24; // Fewer than 2^32 positions
+
+  struct alignas(64) Line{
+    uint32_t counts[4];
+    uint64_t masks[6];
+  };
+
+  Array<Line> lines;
+  Array<int64_t> superblock_counts; // Counts of A, C, G, T before each superblock
+  int64_t n_positions = 0;
+
+  InterleavedSBWT() {}
+
+  // From the out-edge masks of the positions
+  InterleavedSBWT(const vector<uint8_t>& out_edges)
+    : lines(out_edges.size() / LINE_POSITIONS + 1),
+      superblock_counts(4 * ((lines.size() + SUPERBLOCK_LINES - 1) / SUPERBLOCK_LINES)),
+      n_positions(out_edges.size()) {
+    int64_t counts[4] = {0, 0, 0, 0};
+    for(int64_t i = 0; i < (int64_t)lines.size(); i++){
+      Line& line = lines[i];
+      int64_t superblock = i / SUPERBLOCK_LINES;
+      if(i % SUPERBLOCK_LINES == 0)
+        for(int c = 0; c < 4; c++) superblock_counts[4*superblock + c] = counts[c];
+      for(int c = 0; c < 4; c++) line.counts[c] = counts[c] - superblock_counts[4*superblock + c];
+      for(int w = 0; w < 6; w++) line.masks[w] = 0;
+      for(int64_t j = 0; j < LINE_POSITIONS && i * LINE_POSITIONS + j < n_positions; j++){
+        uint64_t mask = out_edges[i * LINE_POSITIONS + j] & 0xF;
+        line.masks[j / 16] |= mask << (4 * (j % 16));
+        for(int c = 0; c < 4; c++) counts[c] += (mask >> c) & 1;
+      }
+    }
+  }
+
+  int64_t size() const { return n_positions; }
+
+  // Out-edge mask of position i
+  uint8_t operator[](int64_t i) const {
+    const Line& line = lines[i / LINE_POSITIONS];
+    int64_t j = i % LINE_POSITIONS;
+    return (line.masks[j / 16] >> (4 * (j % 16))) & 0xF;
+  }
+
+  // Number of positions in [0..position) that have an out-edge with character code c
+  int64_t rank(int c, int64_t position) const {
+    BOSS_COUNT(rank_calls);
+    int64_t i = position / LINE_POSITIONS;
+    const Line& line = lines[i];
+    int64_t j = position % LINE_POSITIONS;
+    uint64_t select_c = 0x1111111111111111ULL << c;
+    uint64_t selected[6];
+    for(int w = 0; w < 6; w++) selected[w] = line.masks[w] & select_c;
+    return superblock_counts[4*(i / SUPERBLOCK_LINES) + c] + line.counts[c] + popcount_prefix(selected, 4 * j);
+  }
+
+  // Brings the line that rank(c, position) reads into the cache ahead of time
+  void prefetch(int64_t position) const {
+    __builtin_prefetch(&lines[position / LINE_POSITIONS]);
+  }
+
+  void serialize(IndexWriter& out) const {
+    out.write_scalar(n_positions);
+    out.write_array(lines);
+    out.write_array(superblock_counts);
+  }
+
+  static InterleavedSBWT load(IndexReader& in){
+    InterleavedSBWT sbwt;
+    sbwt.n_positions = in.read_scalar();
+    sbwt.lines = in.read_array<Line>();
+    sbwt.superblock_counts = in.read_array<int64_t>();
+    return sbwt;
+  }
+};
@@ -0,0 +1,426 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <set>
+#include <stdexcept>
+#include <algorithm>
+#include <queue>
+#include "parallel.hh"
+
+using std::string;
+using std::vector;
+using std::set;
+
+// Integer-encoded node lists for constructing the edge-centric de Bruijn graph structures.
+// A node label of length k is stored reversed, 2 bits per character, with the last character
+// in the most significant bits. Dummy nodes $^{k-i}X are stored with the i real characters
+// and zeros in place of the dollars, and ties are broken by the number of real characters.
+// With this encoding colexicographic order is plain integer order, so the node list can be
+// radix sorted. Use kmer_t = uint64_t for k <= 32 and kmer_t = __uint128_t for k <= 64.
+
+template <typename kmer_t>
+struct KmerNode{
+  kmer_t key;
+  uint8_t length; // Number of non-dollar characters. Less than k only for dummy nodes.
+  uint8_t edges; // Bits 0..3: outgoing A,C,G,T. Bits 4..7: incoming A,C,G,T.
+
+  bool operator<(const KmerNode& other) const {
+    return key < other.key || (key == other.key && length < other.length);
+  }
+  bool operator==(const KmerNode& other) const {
+    return key == other.key && length == other.length;
+  }
+};
+
+// A,C,G,T -> 0,1,2,3. Other characters -> -1.
+inline int nucleotide_code(char c){
+  switch(c){
+    case 'A': return 0;
+    case 'C': return 1;
+    case 'G': return 2;
+    case 'T': return 3;
+    default: return -1;
+  }
+}
+
+// Reverse complement over A, C, G, T. Other characters are kept as they are, so that
+// they still break the k-mers that contain them.
+inline string reverse_complement(const string& S){
+  string R(S.rbegin(), S.rend());
+  for(char& c : R){
+    switch(c){
+      case 'A': c = 'T'; break;
+      case 'C': c = 'G'; break;
+      case 'G': c = 'C'; break;
+      case 'T': c = 'A'; break;
+    }
+  }
+  return R;
+}
+
+template <typename kmer_t>
+void check_k(int k){
+  if(k < 1 || 2 * k > 8 * (int)sizeof(kmer_t))
+    throw std::invalid_argument("k = " + std::to_string(k) + " does not fit in the k-mer integer type");
+}
+
+// Label of the node, with the dollar padding
+template <typename kmer_t>
+string decode_label(const KmerNode<kmer_t>& node, int k){
+  string label(k, '$');
+  for(int i = 0; i < node.length; i++) // i-th character from the end
+    label[k-1-i] = "ACGT"[(node.key >> (2*(k-1-i))) & 3];
+  return label;
+}
+
+// Key of a k-mer over A, C, G, T, the same as the key of its node
+template <typename kmer_t>
+kmer_t encode_kmer(const string& kmer){
+  kmer_t key = 0;
+  for(int64_t i = (int64_t)kmer.size() - 1; i >= 0; i--)
+    key = (key << 2) | kmer_t(nucleotide_code(kmer[i]));
+  return key;
+}
+
+// Last character of the label, or '$' for the root
+template <typename kmer_t>
+char last_character(const KmerNode<kmer_t>& node, int k){
+  if(node.length == 0) return '$';
+  return "ACGT"[(node.key >> (2*(k-1))) & 3];
+}
+
+// True if the labels of the nodes agree on their last k-1 characters,
+// in which case the nodes have the same successor for each outgoing character.
+template <typename kmer_t>
+bool same_suffix_group(const KmerNode<kmer_t>& a, const KmerNode<kmer_t>& b, int k){
+  return (a.key >> 2) == (b.key >> 2) && std::min<int>(a.length, k-1) == std::min<int>(b.length, k-1);
+}
+
+// Length of the longest common suffix of the labels, not counting dollars
+template <typename kmer_t>
+int longest_common_suffix(const KmerNode<kmer_t>& a, const KmerNode<kmer_t>& b, int k){
+  int max_length = std::min(a.length, b.length);
+  kmer_t diff = a.key ^ b.key;
+  int ans = 0;
+  while(ans < max_length && ((diff >> (2*(k-1-ans))) & 3) == 0) ans++;
+  return ans;
+}
+
+// Appends the nodes of the k-mers of S that start in [begin, end). If begin is 0,
+// also appends the dummy prefixes $^{k-i}S[0..i).
+// Characters in [begin, end+k-1) must be A, C, G, T.
+template <typename kmer_t>
+void add_sequence_nodes(const string& S, int k, vector<KmerNode<kmer_t>>& nodes, int64_t begin = 0, int64_t end = -1){
+  if(S.size() < (size_t)k) return;
+  if(end < 0) end = S.size() - k + 1;
+  for(int64_t i = begin; i < end + k - 1; i++)
+    if(nucleotide_code(S[i]) < 0) throw std::invalid_argument(string("Invalid character in input: ") + S[i]);
+
+  kmer_t key = 0;
+  if(begin == 0){
+    // Dummies. The full k-mer (i = k) is added below.
+    for(int i = 0; i < k; i++){
+      nodes.push_back({key, (uint8_t)i, (uint8_t)(1 << nucleotide_code(S[i]))});
+      key = (key >> 2) | (kmer_t(nucleotide_code(S[i])) << (2*(k-1)));
+    }
+  } else {
+    for(int64_t i = begin; i < begin + k; i++)
+      key = (key >> 2) | (kmer_t(nucleotide_code(S[i])) << (2*(k-1)));
+  }
+
+  // Non-dummies. The key is updated by rolling the new character into the top bits.
+  for(int64_t i = begin; i < end; i++){
+    if(i > begin) key = (key >> 2) | (kmer_t(nucleotide_code(S[i+k-1])) << (2*(k-1)));
+    // The neighbouring characters lie outside the validated window, so a character other
+    // than A, C, G, T there means no edge
+    uint8_t edges = 0;
+    int in = i > 0 ? nucleotide_code(S[i-1]) : -1;
+    int out = i + k < (int64_t)S.size() ? nucleotide_code(S[i+k]) : -1;
+    if(in >= 0) edges |= 1 << (4 + in);
+    if(out >= 0) edges |= 1 << out;
+    nodes.push_back({key, (uint8_t)k, edges});
+  }
+}
+
+// LSD radix sort by (key, length), one byte per pass. Passes where all records
+// have the same byte are skipped.
+template <typename kmer_t>
+void radix_sort_nodes(vector<KmerNode<kmer_t>>& nodes, int k){
+  vector<KmerNode<kmer_t>> buffer(nodes.size());
+  int key_bytes = (2*k + 7) / 8;
+  for(int pass = -1; pass < key_bytes; pass++){ // Pass -1 sorts by length
+    auto byte_of = [pass](const KmerNode<kmer_t>& x) -> int {
+      if(pass < 0) return x.length;
+      return (int)((x.key >> (8*pass)) & 0xFF);
+    };
+    vector<int64_t> offsets(257);
+    for(const KmerNode<kmer_t>& x : nodes) offsets[byte_of(x) + 1]++;
+    bool trivial = false;
+    for(int b = 1; b <= 256; b++) if(offsets[b] == (int64_t)nodes.size()) trivial = true;
+    if(trivial) continue;
+    for(int b = 1; b <= 256; b++) offsets[b] += offsets[b-1];
+    for(const KmerNode<kmer_t>& x : nodes) buffer[offsets[byte_of(x)]++] = x;
+    nodes.swap(buffer);
+  }
+}
+
+// Merges runs of equal nodes in a sorted list, taking the union of their edges
+template <typename kmer_t>
+void merge_duplicate_nodes(vector<KmerNode<kmer_t>>& nodes){
+  int64_t out = 0;
+  for(int64_t i = 0; i < (int64_t)nodes.size(); i++){
+    if(out > 0 && nodes[out-1] == nodes[i]) nodes[out-1].edges |= nodes[i].edges;
+    else nodes[out++] = nodes[i];
+  }
+  nodes.resize(out);
+}
+
+// Merges sorted, deduplicated runs into one. The key space is cut at splitters taken
+// from the largest run, and each thread merges one slice of all runs with a heap.
+template <typename kmer_t>
+vector<KmerNode<kmer_t>> merge_sorted_runs(vector<vector<KmerNode<kmer_t>>>& runs, int n_threads){
+  typedef KmerNode<kmer_t> Node;
+  int64_t n_runs = runs.size();
+  int64_t largest = 0;
+  for(int64_t r = 0; r < n_runs; r++)
+    if(runs[r].size() > runs[largest].size()) largest = r;
+  vector<int64_t> splitter_positions = split_range(runs[largest].size(), n_threads);
+
+  // Slice p of run r is [cuts[p][r], cuts[p+1][r])
+  int64_t n_slices = splitter_positions.size() - 1;
+  vector<vector<int64_t>> cuts(n_slices + 1, vector<int64_t>(n_runs));
+  for(int64_t p = 1; p < n_slices; p++){
+    if(splitter_positions[p] == (int64_t)runs[largest].size()){
+      for(int64_t r = 0; r < n_runs; r++) cuts[p][r] = runs[r].size();
+      continue;
+    }
+    Node splitter = runs[largest][splitter_positions[p]];
+    for(int64_t r = 0; r < n_runs; r++)
+      cuts[p][r] = std::lower_bound(runs[r].begin(), runs[r].end(), splitter) - runs[r].begin();
+  }
+  for(int64_t r = 0; r < n_runs; r++) cuts[n_slices][r] = runs[r].size();
+
+  vector<vector<Node>> slices(n_slices);
+  parallel_for(n_slices, n_threads, [&](int64_t p){
+    typedef std::pair<Node, int64_t> Item; // (node, run)
+    auto greater = [](const Item& a, const Item& b){ return b.first < a.first; };
+    std::priority_queue<Item, vector<Item>, decltype(greater)> heap(greater);
+    vector<int64_t> next = cuts[p];
+    for(int64_t r = 0; r < n_runs; r++)
+      if(next[r] < cuts[p+1][r]) heap.push({runs[r][next[r]++], r});
+    while(!heap.empty()){
+      Item top = heap.top();
+      heap.pop();
+      if(!slices[p].empty() && slices[p].back() == top.first) slices[p].back().edges |= top.first.edges;
+      else slices[p].push_back(top.first);
+      if(next[top.second] < cuts[p+1][top.second])
+        heap.push({runs[top.second][next[top.second]++], top.second});
+    }
+  });
+  runs.clear();
+  runs.shrink_to_fit();
+
+  // Concatenate the slices
+  vector<int64_t> offsets(n_slices + 1);
+  for(int64_t p = 0; p < n_slices; p++) offsets[p+1] = offsets[p] + slices[p].size();
+  vector<Node> nodes(offsets[n_slices]);
+  parallel_for(n_slices, n_threads, [&](int64_t p){
+    std::copy(slices[p].begin(), slices[p].end(), nodes.begin() + offsets[p]);
+    vector<Node>().swap(slices[p]);
+  });
+  return nodes;
+}
+
+// Colex-sorted, deduplicated node list of the input, including dummies.
+// The k-mer start positions of all sequences are split into n_threads equal ranges
+// (long sequences are cut between threads), and each thread extracts, sorts and
+// deduplicates one run. With both_strands, the reverse complement of every sequence is
+// added as well: a thread also takes the mirror image of its range on the other strand.
+template <typename kmer_t>
+vector<KmerNode<kmer_t>> construct_node_list(const vector<string>& input, int k, int n_threads = 1, bool both_strands = false){
+  check_k<kmer_t>(k);
+  n_threads = std::max(n_threads, 1);
+
+  vector<int64_t> first_window(input.size() + 1); // Global index of the first k-mer of each sequence
+  for(int64_t i = 0; i < (int64_t)input.size(); i++)
+    first_window[i+1] = first_window[i] + std::max<int64_t>(0, (int64_t)input[i].size() - k + 1);
+  vector<int64_t> ranges = split_range(first_window.back(), n_threads);
+
+  vector<vector<KmerNode<kmer_t>>> runs(n_threads);
+  parallel_for(n_threads, n_threads, [&](int64_t t){
+    int64_t i = std::upper_bound(first_window.begin(), first_window.end(), ranges[t]) - first_window.begin() - 1;
+    for(; i < (int64_t)input.size() && first_window[i] < ranges[t+1]; i++){
+      int64_t begin = std::max(ranges[t], first_window[i]) - first_window[i];
+      int64_t end = std::min(ranges[t+1], first_window[i+1]) - first_window[i];
+      if(begin >= end) continue;
+      add_sequence_nodes(input[i], k, runs[t], begin, end);
+      int64_t n_windows = first_window[i+1] - first_window[i];
+      if(both_strands) add_sequence_nodes(reverse_complement(input[i]), k, runs[t], n_windows - end, n_windows - begin);
+    }
+    radix_sort_nodes(runs[t], k);
+    merge_duplicate_nodes(runs[t]);
+  });
+
+  if(n_threads == 1) return std::move(runs[0]);
+  return merge_sorted_runs(runs, n_threads);
+}
+
+// Node list of sequences that arrive in batches, so that the whole input never has
+// to be in memory at once. next_batch(batch) fills the batch and returns false when
+// the input is exhausted. Each batch becomes one sorted run. The runs are merged into
+// the nodes so far once their total size reaches it, so every node is merged a
+// logarithmic number of times, and k-mers repeated across batches do not pile up. A merge
+// holds its inputs and its output, so the peak memory stays below three times the final
+// node list plus one batch and its run.
+template <typename kmer_t, typename BatchFunction>
+vector<KmerNode<kmer_t>> construct_node_list_from_batches(const BatchFunction& next_batch, int k, int n_threads = 1, bool both_strands = false){
+  vector<vector<KmerNode<kmer_t>>> runs(1); // runs[0] holds the nodes merged so far
+  int64_t pending = 0; // Total size of the runs not merged yet
+  vector<string> batch;
+  while(next_batch(batch)){
+    runs.push_back(construct_node_list<kmer_t>(batch, k, n_threads, both_strands));
+    pending += runs.back().size();
+    if(pending < (int64_t)runs[0].size()) continue;
+    vector<KmerNode<kmer_t>> merged = merge_sorted_runs(runs, std::max(n_threads, 1));
+    runs.resize(1);
+    runs[0].swap(merged);
+    pending = 0;
+  }
+  if(runs.size() == 1) return std::move(runs[0]);
+  return merge_sorted_runs(runs, std::max(n_threads, 1));
+}
+
+// Node list of a set of k-mers, given as sorted distinct keys, with an edge between
+// every two k-mers that overlap by k-1 characters. Dummies are added only for k-mers
+// that have no predecessor in the set, and the root is always added.
+template <typename kmer_t>
+vector<KmerNode<kmer_t>> node_list_from_kmers(const vector<kmer_t>& kmers, int k, int n_threads = 1){
+  check_k<kmer_t>(k);
+  n_threads = std::max(n_threads, 1);
+  kmer_t mask = 2*k == 8 * (int)sizeof(kmer_t) ? ~kmer_t(0) : (kmer_t(1) << (2*k)) - 1;
+  auto contains = [&](kmer_t key){ return std::binary_search(kmers.begin(), kmers.end(), key); };
+
+  vector<int64_t> ranges = split_range(kmers.size(), n_threads);
+  vector<vector<KmerNode<kmer_t>>> runs(n_threads);
+  parallel_for(n_threads, n_threads, [&](int64_t t){
+    if(t == 0) runs[t].push_back({0, 0, 0}); // Root
+    for(int64_t i = ranges[t]; i < ranges[t+1]; i++){
+      kmer_t key = kmers[i];
+      uint8_t edges = 0;
+      for(int c = 0; c < 4; c++){
+        if(contains((key >> 2) | (kmer_t(c) << (2*(k-1))))) edges |= 1 << c; // Out
+        if(contains(((key << 2) | kmer_t(c)) & mask)) edges |= 1 << (4 + c); // In
+      }
+      runs[t].push_back({key, (uint8_t)k, edges});
+      if(edges >> 4) continue;
+      kmer_t dummy = 0; // Dummies $^{k-j}X[0..j) with the out-edge X[j]
+      for(int j = 0; j < k; j++){
+        int c = (int)((key >> (2*j)) & 3);
+        runs[t].push_back({dummy, (uint8_t)j, (uint8_t)(1 << c)});
+        dummy = (dummy >> 2) | (kmer_t(c) << (2*(k-1)));
+      }
+    }
+    radix_sort_nodes(runs[t], k);
+    merge_duplicate_nodes(runs[t]);
+  });
+
+  if(n_threads == 1) return std::move(runs[0]);
+  return merge_sorted_runs(runs, n_threads);
+}
+
+// Adds the root $^k to a colex-sorted node list that has none, as happens when no input
+// sequence has dummies left. Returns true if the root was added.
+template <typename kmer_t>
+bool add_missing_root(vector<KmerNode<kmer_t>>& nodes){
+  if(!nodes.empty() && nodes[0].length == 0) return false;
+  nodes.insert(nodes.begin(), KmerNode<kmer_t>{0, 0, 0});
+  return true;
+}
+
+// Removes the dummies that no k-mer needs from a colex-sorted node list and returns how
+// many were removed. Every node except the root needs an in-edge. A k-mer with an in-edge
+// from another k-mer has one already, so only k-mers without such an in-edge need their
+// dummy prefixes. The dummies are resolved from the longest to the shortest: a dummy keeps
+// the out-edges to kept nodes one character longer, and is kept if any remain. The root is
+// always kept.
+template <typename kmer_t>
+int64_t remove_redundant_dummies(vector<KmerNode<kmer_t>>& nodes, int k, int n_threads = 1){
+  n_threads = std::max(n_threads, 1);
+  vector<vector<int64_t>> by_length(k);
+  for(int64_t i = 0; i < (int64_t)nodes.size(); i++)
+    if(nodes[i].length < k) by_length[nodes[i].length].push_back(i);
+
+  vector<uint8_t> keep(nodes.size());
+  for(int64_t i = 0; i < (int64_t)nodes.size(); i++) keep[i] = nodes[i].length == k;
+  // True if the node one character longer needs the in-edge from a dummy
+  auto needs_dummy = [&](kmer_t key, int length){
+    KmerNode<kmer_t> target = {key, (uint8_t)length, 0};
+    int64_t i = std::lower_bound(nodes.begin(), nodes.end(), target) - nodes.begin();
+    if(i == (int64_t)nodes.size() || !(nodes[i] == target)) return false;
+    return length == k ? (nodes[i].edges >> 4) == 0 : keep[i] != 0;
+  };
+
+  for(int length = k - 1; length >= 0; length--){
+    const vector<int64_t>& level = by_length[length];
+    vector<int64_t> ranges = split_range(level.size(), n_threads);
+    parallel_for(n_threads, n_threads, [&](int64_t t){
+      for(int64_t x = ranges[t]; x < ranges[t+1]; x++){
+        KmerNode<kmer_t>& node = nodes[level[x]];
+        uint8_t out = 0;
+        for(int c = 0; c < 4; c++)
+          if(((node.edges >> c) & 1) && needs_dummy((node.key >> 2) | (kmer_t(c) << (2*(k-1))), length + 1)) out |= 1 << c;
+        node.edges = (node.edges & 0xF0) | out;
+        keep[level[x]] = out != 0 || length == 0;
+      }
+    });
+  }
+
+  int64_t out = 0;
+  for(int64_t i = 0; i < (int64_t)nodes.size(); i++)
+    if(keep[i]) nodes[out++] = nodes[i];
+  int64_t removed = nodes.size() - out;
+  nodes.resize(out);
+  return removed;
+}
+
+// Or of the out-edges of the nodes before nodes[i] in the same suffix group
+template <typename kmer_t>
+uint8_t suffix_group_edges_before(const vector<KmerNode<kmer_t>>& nodes, int64_t i, int k){
+  uint8_t edges = 0;
+  for(; i > 0 && same_suffix_group(nodes[i-1], nodes[i], k); i--)
+    edges |= nodes[i-1].edges & 0xF;
+  return edges;
+}
+
+// Outgoing edges that remain after minus-marking, as 4-bit masks. Nodes that agree on
+// their last k-1 characters are consecutive in colex order and share successors, so an
+// out-edge is kept only at the first node of its suffix group that has it. A suffix group
+// has at most five nodes, so each thread can start its range by looking back at most that far.
+template <typename kmer_t>
+vector<uint8_t> unmarked_out_edges(const vector<KmerNode<kmer_t>>& nodes, int k, int n_threads = 1){
+  vector<uint8_t> kept(nodes.size());
+  vector<int64_t> ranges = split_range(nodes.size(), n_threads);
+  parallel_for(n_threads, n_threads, [&](int64_t t){
+    uint8_t seen = suffix_group_edges_before(nodes, ranges[t], k);
+    for(int64_t i = ranges[t]; i < ranges[t+1]; i++){
+      if(i > ranges[t] && !same_suffix_group(nodes[i-1], nodes[i], k)) seen = 0;
+      kept[i] = nodes[i].edges & 0xF & ~seen;
+      seen |= nodes[i].edges & 0xF;
+    }
+  });
+  return kept;
+}
+
+// Whether construction prints the node list and the structure to cout. The dump is meant
+// for the small examples; programs that build from real inputs switch it off.
+inline bool construction_dump = true;
+
+// Characters of a 4-bit edge mask, for debug printing
+inline set<char> edge_set(uint8_t mask){
+  set<char> S;
+  for(int c = 0; c < 4; c++)
+    if(mask & (1 << c)) S.insert("ACGT"[c]);
+  return S;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+#include "select_free_boss.hh"
+#include "dynamic_boss.hh"
+
+using std::vector;
+
+// merge_boss with the node keys in kmer_t
+template <typename kmer_t>
+SelectFreeBOSS merge_boss_nodes(const SelectFreeBOSS& A, const SelectFreeBOSS& B, int n_threads){
+  vector<kmer_t> keys_A, keys_B;
+  vector<uint8_t> lengths_A, lengths_B;
+  extract_labels(A, keys_A, lengths_A, n_threads);
+  extract_labels(B, keys_B, lengths_B, n_threads);
+
+  // Both node lists are colex-sorted, so one merge pass gives the sorted union. A node in
+  // both keeps the out-edges of both.
+  vector<KmerNode<kmer_t>> nodes;
+  nodes.reserve(std::max(A.node_count, B.node_count));
+  int64_t i = 0, j = 0;
+  while(i < A.node_count || j < B.node_count){
+    KmerNode<kmer_t> a = {0, 0, 0}, b = {0, 0, 0};
+    if(i < A.node_count) a = {keys_A[i], lengths_A[i], A.out_edges(i)};
+    if(j < B.node_count) b = {keys_B[j], lengths_B[j], B.out_edges(j)};
+    if(j == B.node_count || (i < A.node_count && a < b)){
+      nodes.push_back(a);
+      i++;
+    } else if(i == A.node_count || b < a){
+      nodes.push_back(b);
+      j++;
+    } else {
+      a.edges |= b.edges;
+      nodes.push_back(a);
+      i++, j++;
+    }
+  }
+  vector<kmer_t>().swap(keys_A);
+  vector<kmer_t>().swap(keys_B);
+  return SelectFreeBOSS::from_node_list(nodes, A.k, n_threads, false, A.has_lcs() || B.has_lcs());
+}
+
+// The index of the union of the k-mers of two indexes with the same k, built without the
+// input sequences. The labels of the nodes of both are recovered in k parallel rounds (see
+// extract_labels), the two colex-ordered node lists are merged in one pass, and the SBWT bits,
+// minus marks, C array and LCS array (if either input has one) are computed from the merged list. Nodes that agree on
+// their last k-1 characters share their out-edges, so keeping the unmarked out-edges of every
+// node keeps all edges of both graphs. The dummies of both are kept.
+//
+// The result has both strands if both inputs have, and the layout and prefix table length of A.
+inline SelectFreeBOSS merge_boss(const SelectFreeBOSS& A, const SelectFreeBOSS& B, int n_threads = 1){
+  if(A.k != B.k) throw std::invalid_argument("Cannot merge indexes with k = " + std::to_string(A.k) + " and k = " + std::to_string(B.k));
+  n_threads = std::max(n_threads, 1);
+  SelectFreeBOSS merged = A.k <= 32 ? merge_boss_nodes<uint64_t>(A, B, n_threads) : merge_boss_nodes<__uint128_t>(A, B, n_threads);
+  merged.both_strands = A.both_strands && B.both_strands;
+  if(A.layout != SelectFreeBOSS::SPLIT) merged.set_layout(A.layout);
+  if(A.prefix_length > 0) merged.build_prefix_table(A.prefix_length, n_threads);
+  return merged;
+}
@@ -1,25 +1,14 @@
 #include <iostream>
-#include <map>
+#include <set>
 #include <string>
-#include <cassert>
-#include <algorithm>
-#include "stdlib_printing.hh"
+#include "original_boss.hh"
 
 using namespace std;
 
-struct BOSS{
-
-    string GBWT; // Generalized BWT
-    string LAST; // Bit vector 'last'
-    vector<int> C; // C-array (cumulative character counts)
-    int n_nodes;
-
-};
-
 struct colex_compare {
     // true if S is colexicographically-smaller than T
     bool operator()(const std::string& S, const std::string& T) const {
-        int i = 0;
+        size_t i = 0;
         while(true){
             if(i == S.size() || i == T.size()){
                 // One of the strings is a suffix of the other. Return the shorter.
@@ -33,149 +22,73 @@ struct colex_compare {
     }
 };
 
-// Counts the number of occurrence of symbol in array[0..position)
-int64_t Rank(const string& S, char symbol, int64_t position){
-    int64_t ans = 0;
-    for(int64_t i = 0; i < position; i++)
-        if(S[i] == symbol) ans++;
-    return ans;
-}
-
-// Returns position i such that array[i] == symbol and
-// symbol occurs `count` times in array[0..i]
-// Using capital S in the name because select conflicts with the standard library
-int64_t Select(const string& S, char symbol, int64_t count){
-    int64_t occurrences_seen = 0;
-    for(int64_t i = 0; ; i++){
-        if(S[i] == symbol) occurrences_seen++;
-        if(occurrences_seen == count) return i;
-    }
-}
-
-vector<int> char_counts_to_C_array(const vector<int>& counts){
-    vector<int> C(256); // Cumulative sum of counts
-
-    // Compute cumulative sum of counts
-    for(int i = 0; i < (int)C.size(); i++){
-        C[i] = counts[i];
-        if(i > 0) C[i] += C[i-1];
-    }
-
-    // Shift C to the right by one because that's how it's defined
-    for(int i = 256-1; i >= 0; i--){
-        if(i == 0) C[i] = 0;
-        else C[i] = C[i-1];
-    }
-
-    return C;
-
-}
-
-
-// Edge-centric definition.
-// k is the length of node labels.
-BOSS construct(const vector<string>& input, int k){
-    map<string, pair<set<char>, set<char>>, colex_compare> kmers; // k-mer -> (incoming labels, outgoing labels)
-
-    // TODO: ensure that root node exists
-    // TODO: avoid adding redundant dummies
-
-    for(const string& S : input){
-        assert(S.size() >= k);
-
-        // Dummies
-        for(int i = 0; i <= k; i++){
-            string prefix = string(k-i, '$') + S.substr(0,i);
-            if(i != 0) kmers[prefix].first.insert('$'); // In
-            if(i < k) kmers[prefix].second.insert(S[i]); // Out
+int main(int argc, char** argv){
+    if(argc >= 2){ // original_boss input.fasta[.gz] k [output.index] [--minimal-dummies]
+        vector<string> args;
+        bool minimal_dummies = false;
+        for(int i = 1; i < argc; i++){
+            if(string(argv[i]) == "--minimal-dummies") minimal_dummies = true;
+            else args.push_back(argv[i]);
         }
-
-        // Non-dummies
-        for(int i = 0; i < S.size()-k+1; i++){
-            string kmer = S.substr(i,k);
-            if(i > 0) kmers[kmer].first.insert(S[i-1]); // In
-            if(i + k < S.size()) kmers[kmer].second.insert(S[i+k]); // Out
+        if(args.size() < 2 || args.size() > 3){
+            cerr << "Usage: " << argv[0] << " input.fasta[.gz] k [output.index] [--minimal-dummies]" << endl;
+            return 1;
         }
-    }
-
-    BOSS boss;
-    boss.n_nodes = kmers.size();
-
-    // Add dollars
-    for(auto& keyval : kmers) {
-        if(keyval.second.second.size() == 0){
-            keyval.second.second.insert('$'); // Outgoing dollar
-            kmers.begin()->second.first.insert('$'); // Incoming dollar to root
+        int64_t k = 0;
+        size_t k_end = 0;
+        try{ k = stoll(args[1], &k_end); } catch(const exception&){}
+        if(k_end != args[1].size() || k < 1 || k > 64){
+            cerr << "ERROR: k must be an integer from 1 to 64, got " << args[1] << endl;
+            return 1;
         }
-    }
-
-    // Construct GBWT with only capital letters, and LAST
-    for(auto& keyval : kmers) {
-        cout << keyval.first << " " << keyval.second << endl;
-        for(char c : keyval.second.second) boss.GBWT += c;
-        while(boss.LAST.size()+1 < boss.GBWT.size()) boss.LAST += '0';
-        boss.LAST += '1';
-    }
-
-    // Add minus marks to GBWT
-    string F_column = boss.GBWT;
-    std::sort(F_column.begin(), F_column.end());
-    vector<bool> minus_marks(boss.GBWT.size());
-    map<char,int> labels_seen;
-    int F_index = 0;
-    for(auto& keyval : kmers) {
-        int indegree = keyval.second.first.size();        
-        char c = F_column[F_index];
-        if(c != '$'){ // Add minuses, but not for dollars
-            for(int i = 1; i < indegree; i++){ // All but the first in-edge
-                minus_marks[Select(boss.GBWT, c, labels_seen[c] + i + 1)] = 1; // Mark the corresponding out-edge
-            }
+        try{
+            SequenceReader reader(args[0]);
+            construction_dump = false;
+            BOSS boss = construct(reader, (int)k, 1 << 28, minimal_dummies);
+            if(minimal_dummies) cout << "Redundant dummies removed: " << boss.removed_dummies << endl;
+            cout << index_stats(boss);
+            if(args.size() >= 3) save(boss, args[2]);
+        } catch(const exception& e){
+            cerr << "ERROR: " << e.what() << endl;
+            return 1;
         }
-        labels_seen[c] += indegree;
-        F_index += indegree;
+        return 0;
     }
 
-    // Apply minus marks
-    for(int i = 0; i < boss.GBWT.size(); i++)
-        if(minus_marks[i]) boss.GBWT[i] = tolower(boss.GBWT[i]);
-
-    vector<int> counts(256);
-    for(char c : boss.GBWT) counts[c]++;
-    boss.C = char_counts_to_C_array(counts);
-
-    cout << boss.GBWT << endl;
-    cout << boss.C << endl;    
-    cout << boss.LAST << endl;
-    return boss;
-
-}
-
-int search(BOSS& boss, const string& kmer){
-    int node_left = 0;
-    int node_right = boss.n_nodes-1;
-    for(int i = 0; i < kmer.size(); i++){
-        int GBWT_left = node_left == 0 ? 0 : Select(boss.LAST, '1', node_left) + 1; // End of previous node +1.
-        int GBWT_right = Select(boss.LAST, '1', node_right+1);
-        char c = kmer[i];
-        node_left = boss.C[c] + Rank(boss.GBWT, c, GBWT_left);
-        node_right = boss.C[c] + Rank(boss.GBWT, c, GBWT_right+1) - 1;
-        if(node_left > node_right) return -1; // Not found
-    }
-    assert(node_left == node_right);
-    return node_left;
-}
-
-int main(){
     vector<string> input = {"GAAGCCGCCATTCCATAGTGAGTCCTTCGTCTGTGACTATCTGTGCCAGATCGTCTAGCAAACTGCTGATCCAGTTTATCTCACCAAATTATAGCCGTACAGACCGAAATCTTAAGTCATATCACGCGACTAGGCTCAGCTTTATTTTTGTGGTCATGGGTTTTGGTCCGCCCGAGCGGTGCAGCCGATTAGGACCATGT"};
     int k = 4;
     BOSS boss = construct(input, k);
     set<string, colex_compare> kmers;
     for(string& S : input)
-        for(int i = 0; i < S.size()-k+1; i++)
+        for(int64_t i = 0; i + k <= (int64_t)S.size(); i++)
             kmers.insert(S.substr(i,k));
 
     for(string kmer : kmers){
         int result = search(boss, kmer);
         cout << result << endl;
     }
+
+    // Check that an index written to disk and mapped back gives the same answers
+    string filename = "original_boss_test.index";
+    save(boss, filename);
+    BOSS loaded = load_BOSS(filename);
+    for(string kmer : kmers)
+        if(search(loaded, kmer) != search(boss, kmer))
+            cout << "ERROR: loaded index returned a different answer for k-mer " << kmer << endl;
+    remove(filename.c_str());
+
+    // Check that k-mers with characters outside ACGT are not found
+    for(string kmer : {string("NAAG"), string("GANG"), string("AAGn")})
+        if(search(boss, kmer) != -1)
+            cout << "ERROR: found k-mer " << kmer << " with a character outside ACGT" << endl;
+
+    // Check the counts of the stats against the node list
+    int64_t n_dummies = 0, n_edges = 0;
+    for(const KmerNode<uint64_t>& node : construct_node_list<uint64_t>(input, k)){
+        n_dummies += node.length > 0 && node.length < k;
+        n_edges += __builtin_popcount(node.edges & 0xF);
+    }
+    IndexStats stats = index_stats(boss);
+    if(stats.n_kmers() != (int64_t)kmers.size() || stats.n_dummies != n_dummies || stats.n_edges != n_edges)
+        cout << "ERROR: wrong stats" << endl << stats;
 }
\ No newline at end of file
@@ -0,0 +1,331 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <cassert>
+#include <algorithm>
+#include "stdlib_printing.hh"
+#include "bit_vector.hh"
+#include "popcount.h"
+#include "query_counters.h"
+#include "kmer_nodes.hh"
+#include "sequence_reader.hh"
+#include "index_stats.hh"
+
+using std::string;
+using std::vector;
+using std::ostream;
+using std::cout;
+using std::endl;
+
+// Generalized BWT over {A,C,G,T,a,c,g,t,$}, where lowercase letters are minus-marked.
+// Each character is a 2-bit nucleotide code plus a flag bit that is set for minus-marked
+// characters and dollars, stored as three consecutive words per 64 characters. Dollars
+// (one per sink node) are rare, so their positions are kept in a sorted list. Counts of
+// the eight letters use the same two-level superblock/block layout as BitVector.
+struct PackedGBWT{
+
+    static const int64_t BLOCK_CHARS = 512;
+    static const int64_t SUPERBLOCK_CHARS = 1 << 16;
+
+    Array<uint64_t> words; // lo-bits, hi-bits and flag-bits of each 64 characters
+    Array<int64_t> dollars; // Sorted positions of '$'
+    Array<uint64_t> superblock_counts; // 8 absolute counts per superblock
+    Array<uint16_t> block_counts; // 8 counts per block, relative to the superblock
+    int64_t length = 0;
+
+    PackedGBWT() {}
+
+    explicit PackedGBWT(const string& S) : PackedGBWT((int64_t)S.size()) {
+        for(int64_t i = 0; i < length; i++) set(i, S[i]);
+        init_counts();
+    }
+
+    // Length characters, all 'A' until set. Fill with set() and call init_counts() before
+    // querying, so that the characters need not be in memory as a string first.
+    explicit PackedGBWT(int64_t length) : words(3 * (length / BLOCK_CHARS + 1) * (BLOCK_CHARS / 64)), length(length) {}
+
+    // Character i must not have been set yet, and dollars must be set in increasing order
+    void set(int64_t i, char c){
+        int64_t symbol = symbol_index(c);
+        if(c == '$') dollars.push_back(i);
+        else assert(symbol >= 0);
+        int64_t code = c == '$' ? 0 : symbol & 3;
+        bool flag = c == '$' || symbol >= 4;
+        uint64_t bit = uint64_t(1) << (i & 63);
+        if(code & 1) words[3*(i >> 6)] |= bit;
+        if(code & 2) words[3*(i >> 6) + 1] |= bit;
+        if(flag) words[3*(i >> 6) + 2] |= bit;
+    }
+
+    // Builds the block and superblock counts from the characters
+    void init_counts(){
+        int64_t n_blocks = length / BLOCK_CHARS + 1;
+        block_counts.resize(8 * n_blocks);
+        superblock_counts.resize(8 * (length / SUPERBLOCK_CHARS + 1));
+        vector<uint64_t> totals(8);
+        for(int64_t b = 0; b < n_blocks; b++){
+            int64_t superblock = b * BLOCK_CHARS / SUPERBLOCK_CHARS;
+            for(int64_t symbol = 0; symbol < 8; symbol++){
+                if(b * BLOCK_CHARS % SUPERBLOCK_CHARS == 0) superblock_counts[8*superblock + symbol] = totals[symbol];
+                block_counts[8*b + symbol] = totals[symbol] - superblock_counts[8*superblock + symbol];
+            }
+            for(int64_t i = b * BLOCK_CHARS; i < (b+1) * BLOCK_CHARS && i < length; i++){
+                char c = (*this)[i];
+                if(c != '$') totals[symbol_index(c)]++;
+            }
+        }
+    }
+
+    // A,C,G,T -> 0,1,2,3 and a,c,g,t -> 4,5,6,7. Other characters -> -1.
+    static int64_t symbol_index(char c){
+        switch(c){
+            case 'A': return 0; case 'C': return 1; case 'G': return 2; case 'T': return 3;
+            case 'a': return 4; case 'c': return 5; case 'g': return 6; case 't': return 7;
+            default: return -1;
+        }
+    }
+
+    int64_t dollars_before(int64_t position) const {
+        return std::lower_bound(dollars.begin(), dollars.end(), position) - dollars.begin();
+    }
+
+    // Counts the number of occurrences of c in GBWT[0..position)
+    int64_t rank(char c, int64_t position) const {
+        BOSS_COUNT(rank_calls);
+        if(c == '$') return dollars_before(position);
+        int64_t symbol = symbol_index(c);
+        if(symbol < 0) return 0;
+        int64_t block = position / BLOCK_CHARS;
+        int64_t ans = superblock_counts[8*(position / SUPERBLOCK_CHARS) + symbol] + block_counts[8*block + symbol];
+        const uint64_t* block_words = words.data() + 3 * block * (BLOCK_CHARS / 64);
+        const uint64_t* planes[3] = {block_words, block_words + 1, block_words + 2};
+        ans += match_prefix(planes, 3, 3, symbol, position - block * BLOCK_CHARS);
+        if(symbol == 4) // Dollars in the scanned range were counted as 'a'
+            ans -= dollars_before(position) - dollars_before(block * BLOCK_CHARS);
+        return ans;
+    }
+
+    char operator[](int64_t i) const {
+        int64_t w = 3*(i >> 6), bit = i & 63;
+        int64_t code = ((words[w] >> bit) & 1) | (((words[w+1] >> bit) & 1) << 1);
+        if(((words[w+2] >> bit) & 1) == 0) return "ACGT"[code];
+        if(std::binary_search(dollars.begin(), dollars.end(), i)) return '$';
+        return "acgt"[code];
+    }
+
+    int64_t size() const { return length; }
+
+    void serialize(IndexWriter& out) const {
+        out.write_scalar(length);
+        out.write_array(words);
+        out.write_array(dollars);
+        out.write_array(superblock_counts);
+        out.write_array(block_counts);
+    }
+
+    // The arrays point into the mapping of the reader
+    static PackedGBWT load(IndexReader& in){
+        PackedGBWT P;
+        P.length = in.read_scalar();
+        P.words = in.read_array<uint64_t>();
+        P.dollars = in.read_array<int64_t>();
+        P.superblock_counts = in.read_array<uint64_t>();
+        P.block_counts = in.read_array<uint16_t>();
+        return P;
+    }
+
+    string to_string() const {
+        string S(length, ' ');
+        for(int64_t i = 0; i < length; i++) S[i] = (*this)[i];
+        return S;
+    }
+
+};
+
+inline ostream& operator<<(ostream& os, const PackedGBWT& GBWT){
+    return os << GBWT.to_string();
+}
+
+struct BOSS{
+
+    PackedGBWT GBWT; // Generalized BWT
+    BitVector LAST; // Bit vector 'last' with rank and select support
+    vector<int> C; // C-array (cumulative character counts)
+    int n_nodes;
+    int k;
+    int64_t removed_dummies = 0; // Redundant dummy nodes left out by the construction. Not stored in index files.
+    std::shared_ptr<const void> mapping; // Keeps a loaded index file mapped
+
+};
+
+// Writes the structure to a binary index file
+inline void save(const BOSS& boss, const string& filename){
+    IndexWriter out(filename, INDEX_BOSS);
+    out.write_scalar(boss.k);
+    out.write_scalar(boss.n_nodes);
+    out.write_array(boss.C);
+    boss.GBWT.serialize(out);
+    boss.LAST.serialize(out);
+    out.close();
+}
+
+// Maps an index file into memory and queries it in place
+inline BOSS load_BOSS(const string& filename){
+    IndexReader in(filename, INDEX_BOSS);
+    BOSS boss;
+    boss.k = in.read_scalar();
+    boss.n_nodes = in.read_scalar();
+    boss.C = in.read_vector<int>();
+    boss.GBWT = PackedGBWT::load(in);
+    boss.LAST = BitVector::load(in);
+    boss.mapping = in.mapping();
+    return boss;
+}
+
+inline vector<int> char_counts_to_C_array(const vector<int>& counts){
+    vector<int> C(256); // Cumulative sum of counts
+
+    // Compute cumulative sum of counts
+    for(int i = 0; i < (int)C.size(); i++){
+        C[i] = counts[i];
+        if(i > 0) C[i] += C[i-1];
+    }
+
+    // Shift C to the right by one because that's how it's defined
+    for(int i = 256-1; i >= 0; i--){
+        if(i == 0) C[i] = 0;
+        else C[i] = C[i-1];
+    }
+
+    return C;
+
+}
+
+
+// Edge-centric definition.
+// k is the length of node labels.
+// Builds the structure from the colex-sorted node list, which must start with the root.
+// The minus marks are found on n_threads threads. The packing pass is sequential.
+template <typename kmer_t>
+BOSS construct_packed(const vector<KmerNode<kmer_t>>& nodes, int k, int n_threads = 1){
+    if(nodes.empty() || nodes[0].length != 0) throw std::invalid_argument("The node list has no root");
+
+    vector<uint8_t> unmarked = unmarked_out_edges(nodes, k, n_threads);
+
+    BOSS boss;
+    boss.n_nodes = nodes.size();
+    boss.k = k;
+
+    // Construct GBWT and LAST, written directly into their packed forms. Minus-marked
+    // edges are lowercase, and nodes without out-edges get an outgoing dollar. A first
+    // pass over the out-edge masks gives the length.
+    int64_t length = 0;
+    for(const KmerNode<kmer_t>& node : nodes) length += std::max(__builtin_popcount(node.edges & 0xF), 1);
+    boss.GBWT = PackedGBWT(length);
+    boss.LAST = BitVector(length);
+    vector<int> counts(256);
+    int64_t position = 0;
+    for(int64_t i = 0; i < boss.n_nodes; i++){
+        if(construction_dump) cout << decode_label(nodes[i], k) << " " << std::make_pair(edge_set(nodes[i].edges >> 4), edge_set(nodes[i].edges & 0xF)) << endl;
+        uint8_t out = nodes[i].edges & 0xF;
+        auto append = [&](char c){
+            boss.GBWT.set(position++, c);
+            counts[(unsigned char)c]++;
+        };
+        if(out == 0) append('$');
+        for(int c = 0; c < 4; c++){
+            if(unmarked[i] & (1 << c)) append("ACGT"[c]);
+            else if(out & (1 << c)) append("acgt"[c]);
+        }
+        boss.LAST.set(position - 1, 1);
+    }
+    boss.GBWT.init_counts();
+
+    counts['$'] = 1; // Only the root's label ends in '$'. The dollars in the GBWT are out-edges of sink nodes.
+    boss.C = char_counts_to_C_array(counts);
+
+    boss.LAST.init_rank_support();
+    boss.LAST.init_select_support();
+
+    if(!construction_dump) return boss;
+    cout << boss.GBWT << endl;
+    cout << boss.C << endl;    
+    cout << boss.LAST << endl;
+    return boss;
+
+}
+
+// Builds the structure from the node list of the input, which has every dummy. With
+// minimal_dummies, only the dummies that some k-mer needs are kept (see remove_redundant_dummies).
+template <typename kmer_t>
+BOSS construct_from_input(vector<KmerNode<kmer_t>> nodes, int k, bool minimal_dummies, int n_threads){
+    int64_t removed = minimal_dummies ? remove_redundant_dummies(nodes, k, n_threads) : 0;
+    add_missing_root(nodes);
+    BOSS boss = construct_packed(nodes, k, n_threads);
+    boss.removed_dummies = removed;
+    return boss;
+}
+
+// k <= 64. The node list is built on n_threads threads.
+inline BOSS construct(const vector<string>& input, int k, bool minimal_dummies = false, int n_threads = 1){
+    n_threads = std::max(n_threads, 1);
+    if(k <= 32) return construct_from_input(construct_node_list<uint64_t>(input, k, n_threads), k, minimal_dummies, n_threads);
+    else return construct_from_input(construct_node_list<__uint128_t>(input, k, n_threads), k, minimal_dummies, n_threads);
+}
+
+// Reads the input in batches of about batch_bases characters. Sequences are split at non-ACGT characters.
+inline BOSS construct(SequenceReader& input, int k, int64_t batch_bases = 1 << 28, bool minimal_dummies = false, int n_threads = 1){
+    n_threads = std::max(n_threads, 1);
+    auto next_batch = [&](vector<string>& batch){ return input.read_batch(batch, batch_bases, k); };
+    if(k <= 32) return construct_from_input(construct_node_list_from_batches<uint64_t>(next_batch, k, n_threads), k, minimal_dummies, n_threads);
+    else return construct_from_input(construct_node_list_from_batches<__uint128_t>(next_batch, k, n_threads), k, minimal_dummies, n_threads);
+}
+
+inline int search(BOSS& boss, const string& kmer){
+    int node_left = 0;
+    int node_right = boss.n_nodes-1;
+    BOSS_COUNT(queries);
+    for(int i = 0; i < (int)kmer.size(); i++){
+        int GBWT_left = node_left == 0 ? 0 : boss.LAST.select1(node_left) + 1; // End of previous node +1.
+        int GBWT_right = boss.LAST.select1(node_right+1);
+        char c = kmer[i];
+        if(nucleotide_code(c) < 0){ // Not in the alphabet
+            BOSS_COUNT(early_terminations);
+            return -1;
+        }
+        node_left = boss.C[c] + boss.GBWT.rank(c, GBWT_left);
+        node_right = boss.C[c] + boss.GBWT.rank(c, GBWT_right+1) - 1;
+        BOSS_COUNT(search_steps);
+        if(node_left > node_right){ // Not found
+            if(i + 1 < (int)kmer.size()) BOSS_COUNT(early_terminations);
+            return -1;
+        }
+    }
+    assert(node_left == node_right);
+    return node_left;
+}
+
+// Sizes of the components of the structure and its node counts. Counting the dummies
+// walks them from the root, which takes a few rank and select queries per dummy.
+inline IndexStats index_stats(const BOSS& boss){
+    IndexStats stats;
+    stats.structure = "BOSS";
+    stats.k = boss.k;
+    stats.n_nodes = boss.n_nodes;
+    stats.n_edges = boss.GBWT.size() - boss.GBWT.dollars.size();
+    stats.add("GBWT characters", 8 * boss.GBWT.words.size());
+    stats.add("GBWT dollar positions", 8 * boss.GBWT.dollars.size());
+    stats.add("GBWT rank directory", 8 * boss.GBWT.superblock_counts.size() + 2 * boss.GBWT.block_counts.size());
+    stats.add("LAST", boss.LAST);
+    stats.add("C array", sizeof(int) * boss.C.size());
+    stats.n_dummies = count_dummies(boss.n_nodes, boss.k, [&](int64_t u, vector<int64_t>& out){
+        int64_t begin = u == 0 ? 0 : boss.LAST.select1(u) + 1;
+        int64_t end = boss.LAST.select1(u + 1);
+        for(int64_t i = begin; i <= end; i++){
+            char c = boss.GBWT[i];
+            if(nucleotide_code(c) >= 0) out.push_back(boss.C[c] + boss.GBWT.rank(c, i)); // Minus-marked edges are lowercase
+        }
+    });
+    return stats;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <mutex>
+#include <exception>
+#include <deque>
+#include <functional>
+#include <condition_variable>
+
+using std::vector;
+
+// Runs f(i) for every i in [0, n) on n_threads threads. Tasks are handed out one at
+// a time from a shared counter, so tasks of uneven size balance out. The first
+// exception thrown by a task is rethrown in the calling thread.
+template <typename Function>
+void parallel_for(int64_t n, int n_threads, const Function& f){
+  std::atomic<int64_t> next(0);
+  std::exception_ptr error;
+  std::mutex error_mutex;
+  auto worker = [&](){
+    try{
+      for(int64_t i = next++; i < n; i = next++) f(i);
+    } catch(...){
+      std::lock_guard<std::mutex> lock(error_mutex);
+      if(!error) error = std::current_exception();
+      next = n; // Stop handing out tasks
+    }
+  };
+  n_threads = std::max<int64_t>(1, std::min<int64_t>(n_threads, n));
+  if(n_threads == 1){
+    worker();
+  } else {
+    vector<std::thread> threads;
+    for(int t = 0; t < n_threads; t++) threads.emplace_back(worker);
+    for(std::thread& thread : threads) thread.join();
+  }
+  if(error) std::rethrow_exception(error);
+}
+
+// Splits [0, n) into n_parts ranges whose lengths are multiples of `alignment`
+// (except the last). Returns the n_parts + 1 range boundaries.
+inline vector<int64_t> split_range(int64_t n, int64_t n_parts, int64_t alignment = 1){
+  int64_t part = (n / std::max<int64_t>(n_parts, 1) + alignment - 1) / alignment * alignment;
+  part = std::max(part, alignment);
+  vector<int64_t> boundaries;
+  for(int64_t i = 0; i < n_parts; i++) boundaries.push_back(std::min(n, i * part));
+  boundaries.push_back(n);
+  return boundaries;
+}
+
+// Thread pool with one queue shared by all workers, behind one mutex. Tasks are taken
+// in submission order, so that results that must be consumed in that order do not pile
+// up behind a late task, and a task of uneven size delays only the worker that runs it.
+// The lock is held only to push or pop a task, which is cheap next to tasks that
+// take milliseconds. The first exception thrown by a task is rethrown by wait().
+class ThreadPool{
+public:
+  ThreadPool(int n_threads){
+    for(int t = 0; t < std::max(n_threads, 1); t++) workers.emplace_back([this](){ run(); });
+  }
+
+  // Finishes the submitted tasks before returning
+  ~ThreadPool(){
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    work_available.notify_all();
+    for(std::thread& worker : workers) worker.join();
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  void submit(std::function<void()> task){
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      tasks.push_back(std::move(task));
+      pending++;
+    }
+    work_available.notify_one();
+  }
+
+  // Waits until all submitted tasks have finished
+  void wait(){
+    std::unique_lock<std::mutex> lock(mutex);
+    all_done.wait(lock, [&](){ return pending == 0; });
+    if(error){
+      std::exception_ptr e = error;
+      error = nullptr;
+      std::rethrow_exception(e);
+    }
+  }
+
+private:
+  vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable work_available, all_done;
+  std::deque<std::function<void()>> tasks;
+  int64_t pending = 0; // Tasks that have not finished
+  bool stopping = false;
+  std::exception_ptr error;
+
+  void run(){
+    while(true){
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        work_available.wait(lock, [&](){ return !tasks.empty() || stopping; });
+        if(tasks.empty()) return;
+        task = std::move(tasks.front());
+        tasks.pop_front();
+      }
+      try{
+        task();
+      } catch(...){
+        std::lock_guard<std::mutex> lock(mutex);
+        if(!error) error = std::current_exception();
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      if(--pending == 0) all_done.notify_all();
+    }
+  }
+};
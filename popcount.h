@@ -0,0 +1,225 @@
+#pragma once
+
+#include "inttypes.h"
+#include "stdlib.h"
+#include "string.h"
+
+#if defined(__x86_64__)
+#include "immintrin.h"
+#define POPCOUNT_X86 1
+#endif
+
+// Popcount kernels for the in-block part of rank queries, with runtime CPU dispatch.
+// Written in the common subset of C and C++.
+//
+// popcount_prefix counts the ones in the first n_bits bits of an array of words.
+// match_prefix counts the positions among the first n_bits where packed symbols equal
+// a given symbol. Symbol bit j is stored in plane j, and word w of plane j is at
+// planes[j] + w * stride. Bit j of `symbol` is the value the position must have in
+// plane j. Planes beyond n_planes are ignored. match_select is the word scan of select
+// queries: the position of the r-th (1-based) matching position from word w on.
+//
+// The programs are compiled for the baseline instruction set, so __builtin_popcountll
+// is a library call. When the program starts, the fastest kernels the CPU supports are
+// selected: AVX-512 VPOPCNTDQ, AVX2 (nibble lookup with vpshufb), the SSE4.2 era popcnt
+// instruction, or portable code. The environment variable BOSS_POPCOUNT can force one
+// of "avx512", "avx2", "popcnt" or "portable".
+
+typedef struct PopcountKernels{
+
+    const char* name;
+    int64_t (*prefix)(const uint64_t* words, int64_t n_bits);
+    int64_t (*match_prefix)(const uint64_t* const* planes, int64_t n_planes, int64_t stride, int64_t symbol, int64_t n_bits);
+    int64_t (*match_select)(const uint64_t* const* planes, int64_t n_planes, int64_t stride, int64_t symbol, int64_t w, int64_t r);
+
+} PopcountKernels;
+
+// Word of positions that match the symbol in all planes
+static inline uint64_t match_word(const uint64_t* const* planes, int64_t n_planes, int64_t stride, int64_t symbol, int64_t w){
+    uint64_t x = ~(uint64_t)0;
+    for(int64_t j = 0; j < n_planes; j++)
+        x &= ((symbol >> j) & 1) ? planes[j][w * stride] : ~planes[j][w * stride];
+    return x;
+}
+
+// The template for the scalar kernels. Each copy is compiled with different target options.
+#define POPCOUNT_SCALAR_KERNELS(suffix) \
+    static inline int64_t popcount_prefix_##suffix(const uint64_t* words, int64_t n_bits){ \
+        int64_t ans = 0; \
+        for(int64_t w = 0; w < (n_bits >> 6); w++) ans += __builtin_popcountll(words[w]); \
+        if(n_bits & 63) ans += __builtin_popcountll(words[n_bits >> 6] << (64 - (n_bits & 63))); \
+        return ans; \
+    } \
+    static inline int64_t match_prefix_##suffix(const uint64_t* const* planes, int64_t n_planes, int64_t stride, int64_t symbol, int64_t n_bits){ \
+        int64_t ans = 0; \
+        for(int64_t w = 0; w < (n_bits >> 6); w++) ans += __builtin_popcountll(match_word(planes, n_planes, stride, symbol, w)); \
+        if(n_bits & 63) ans += __builtin_popcountll(match_word(planes, n_planes, stride, symbol, n_bits >> 6) << (64 - (n_bits & 63))); \
+        return ans; \
+    } \
+    static inline int64_t match_select_##suffix(const uint64_t* const* planes, int64_t n_planes, int64_t stride, int64_t symbol, int64_t w, int64_t r){ \
+        for(;; w++){ \
+            uint64_t x = match_word(planes, n_planes, stride, symbol, w); \
+            int64_t c = __builtin_popcountll(x); \
+            if(c >= r){ \
+                for(int64_t i = 1; i < r; i++) x &= x - 1; /* Clear the lowest ones */ \
+                return w * 64 + __builtin_ctzll(x); \
+            } \
+            r -= c; \
+        } \
+    }
+
+POPCOUNT_SCALAR_KERNELS(portable)
+
+#ifdef POPCOUNT_X86
+
+#pragma GCC push_options
+#pragma GCC target("popcnt")
+POPCOUNT_SCALAR_KERNELS(popcnt)
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2,popcnt")
+
+// Popcounts of the four words of v
+static inline __m256i popcount_avx2_epi64(__m256i v){
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_nibbles = _mm256_set1_epi8(0x0F);
+    __m256i lo = _mm256_and_si256(v, low_nibbles);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibbles);
+    __m256i bytes = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo), _mm256_shuffle_epi8(lookup, hi));
+    return _mm256_sad_epu8(bytes, _mm256_setzero_si256());
+}
+
+static inline int64_t sum_avx2_epi64(__m256i v){
+    return _mm256_extract_epi64(v, 0) + _mm256_extract_epi64(v, 1) + _mm256_extract_epi64(v, 2) + _mm256_extract_epi64(v, 3);
+}
+
+static inline int64_t popcount_prefix_avx2(const uint64_t* words, int64_t n_bits){
+    int64_t n_words = n_bits >> 6, w = 0;
+    __m256i total = _mm256_setzero_si256();
+    for(; w + 4 <= n_words; w += 4)
+        total = _mm256_add_epi64(total, popcount_avx2_epi64(_mm256_loadu_si256((const __m256i*)(words + w))));
+    int64_t ans = sum_avx2_epi64(total);
+    for(; w < n_words; w++) ans += __builtin_popcountll(words[w]);
+    if(n_bits & 63) ans += __builtin_popcountll(words[n_words] << (64 - (n_bits & 63)));
+    return ans;
+}
+
+static inline int64_t match_prefix_avx2(const uint64_t* const* planes, int64_t n_planes, int64_t stride, int64_t symbol, int64_t n_bits){
+    int64_t n_words = n_bits >> 6, w = 0;
+    __m256i total = _mm256_setzero_si256();
+    for(; w + 4 <= n_words; w += 4){
+        __m256i x = _mm256_set1_epi64x(-1);
+        for(int64_t j = 0; j < n_planes; j++){
+            const uint64_t* p = planes[j] + w * stride;
+            __m256i plane = stride == 1 ? _mm256_loadu_si256((const __m256i*)p)
+                                        : _mm256_setr_epi64x(p[0], p[stride], p[2 * stride], p[3 * stride]);
+            x = ((symbol >> j) & 1) ? _mm256_and_si256(x, plane) : _mm256_andnot_si256(plane, x);
+        }
+        total = _mm256_add_epi64(total, popcount_avx2_epi64(x));
+    }
+    int64_t ans = sum_avx2_epi64(total);
+    for(; w < n_words; w++) ans += __builtin_popcountll(match_word(planes, n_planes, stride, symbol, w));
+    if(n_bits & 63) ans += __builtin_popcountll(match_word(planes, n_planes, stride, symbol, n_words) << (64 - (n_bits & 63)));
+    return ans;
+}
+
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512vpopcntdq,popcnt")
+
+// Sum of the eight words of v. _mm512_reduce_add_epi64 (like _mm512_andnot_si512) passes
+// an undefined vector to its builtin, which GCC reports as uninitialized under -Wall.
+static inline int64_t sum_avx512_epi64(__m512i v){
+    int64_t lanes[8];
+    _mm512_storeu_si512((void*)lanes, v);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + lanes[4] + lanes[5] + lanes[6] + lanes[7];
+}
+
+// Loads n <= 8 words that are `stride` words apart. The other lanes are zero.
+static inline __m512i load_strided_avx512(const uint64_t* p, int64_t stride, int64_t n){
+    __mmask8 mask = (__mmask8)((1 << n) - 1);
+    if(stride == 1) return _mm512_maskz_loadu_epi64(mask, p);
+    __m512i index = _mm512_setr_epi64(0, stride, 2 * stride, 3 * stride, 4 * stride, 5 * stride, 6 * stride, 7 * stride);
+    return _mm512_mask_i64gather_epi64(_mm512_setzero_si512(), mask, index, (const void*)p, 8);
+}
+
+static inline int64_t popcount_prefix_avx512(const uint64_t* words, int64_t n_bits){
+    int64_t n_words = n_bits >> 6, w = 0;
+    __m512i total = _mm512_setzero_si512();
+    for(; w < n_words; w += 8){
+        int64_t n = n_words - w < 8 ? n_words - w : 8;
+        total = _mm512_add_epi64(total, _mm512_popcnt_epi64(load_strided_avx512(words + w, 1, n)));
+    }
+    int64_t ans = sum_avx512_epi64(total);
+    if(n_bits & 63) ans += __builtin_popcountll(words[n_words] << (64 - (n_bits & 63)));
+    return ans;
+}
+
+static inline int64_t match_prefix_avx512(const uint64_t* const* planes, int64_t n_planes, int64_t stride, int64_t symbol, int64_t n_bits){
+    int64_t n_words = n_bits >> 6, w = 0;
+    __m512i total = _mm512_setzero_si512();
+    for(; w < n_words; w += 8){
+        int64_t n = n_words - w < 8 ? n_words - w : 8;
+        __m512i x = _mm512_maskz_mov_epi64((__mmask8)((1 << n) - 1), _mm512_set1_epi64(-1));
+        for(int64_t j = 0; j < n_planes; j++){
+            __m512i plane = load_strided_avx512(planes[j] + w * stride, stride, n);
+            x = _mm512_and_si512(x, ((symbol >> j) & 1) ? plane : _mm512_xor_si512(plane, _mm512_set1_epi64(-1)));
+        }
+        total = _mm512_add_epi64(total, _mm512_popcnt_epi64(x));
+    }
+    int64_t ans = sum_avx512_epi64(total);
+    if(n_bits & 63) ans += __builtin_popcountll(match_word(planes, n_planes, stride, symbol, n_words) << (64 - (n_bits & 63)));
+    return ans;
+}
+
+#pragma GCC pop_options
+
+#endif // POPCOUNT_X86
+
+// Returns the kernels with the given name, or NULL if the CPU does not support them
+static inline const PopcountKernels* popcount_kernels_by_name(const char* name){
+    static const PopcountKernels portable = {"portable", popcount_prefix_portable, match_prefix_portable, match_select_portable};
+    if(strcmp(name, "portable") == 0) return &portable;
+#ifdef POPCOUNT_X86
+    static const PopcountKernels popcnt = {"popcnt", popcount_prefix_popcnt, match_prefix_popcnt, match_select_popcnt};
+    static const PopcountKernels avx2 = {"avx2", popcount_prefix_avx2, match_prefix_avx2, match_select_popcnt};
+    static const PopcountKernels avx512 = {"avx512", popcount_prefix_avx512, match_prefix_avx512, match_select_popcnt};
+    __builtin_cpu_init();
+    if(strcmp(name, "popcnt") == 0 && __builtin_cpu_supports("popcnt")) return &popcnt;
+    if(strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) return &avx2;
+    if(strcmp(name, "avx512") == 0 && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vpopcntdq")) return &avx512;
+#endif
+    return NULL;
+}
+
+// The best kernels for this CPU, or the ones named in BOSS_POPCOUNT
+static inline const PopcountKernels* select_popcount_kernels(void){
+    const char* forced = getenv("BOSS_POPCOUNT");
+    if(forced != NULL && popcount_kernels_by_name(forced) != NULL) return popcount_kernels_by_name(forced);
+    const char* names[] = {"avx512", "avx2", "popcnt"};
+    for(int i = 0; i < 3; i++)
+        if(popcount_kernels_by_name(names[i]) != NULL) return popcount_kernels_by_name(names[i]);
+    return popcount_kernels_by_name("portable");
+}
+
+// Selected before main() runs, so that queries never race on the selection
+static const PopcountKernels* popcount_kernels = NULL;
+
+__attribute__((constructor)) static inline void init_popcount_kernels(void){
+    popcount_kernels = select_popcount_kernels();
+}
+
+static inline int64_t popcount_prefix(const uint64_t* words, int64_t n_bits){
+    return popcount_kernels->prefix(words, n_bits);
+}
+
+static inline int64_t match_prefix(const uint64_t* const* planes, int64_t n_planes, int64_t stride, int64_t symbol, int64_t n_bits){
+    return popcount_kernels->match_prefix(planes, n_planes, stride, symbol, n_bits);
+}
+
+static inline int64_t match_select(const uint64_t* const* planes, int64_t n_planes, int64_t stride, int64_t symbol, int64_t w, int64_t r){
+    return popcount_kernels->match_select(planes, n_planes, stride, symbol, w, r);
+}
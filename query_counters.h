@@ -0,0 +1,41 @@
+#pragma once
+
+#include "inttypes.h"
+
+// Counters of the work done by queries, for profiling query mixes. They are compiled in
+// only with -DBOSS_COUNTERS; otherwise BOSS_COUNT expands to nothing and costs nothing.
+// Each thread counts into its own copy, so the counters need no synchronization. Read and
+// reset them with boss_counters() from the thread that ran the queries.
+// Written in the common subset of C and C++ so that both kinds of programs can include it.
+
+typedef struct QueryCounters{
+
+    int64_t queries; // Searches started: one per k-mer, or one per read for streaming search
+    int64_t search_steps; // Characters matched by backward search, one interval update each
+    int64_t early_terminations; // Searches that ran out of matches before the end of the k-mer
+    int64_t rank_calls;
+    int64_t select_calls;
+
+} QueryCounters;
+
+#ifdef BOSS_COUNTERS
+
+#ifdef __cplusplus
+#define BOSS_THREAD_LOCAL thread_local
+#else
+#define BOSS_THREAD_LOCAL _Thread_local
+#endif
+
+// The counters of the calling thread
+static inline QueryCounters* boss_counters(void){
+    static BOSS_THREAD_LOCAL QueryCounters counters;
+    return &counters;
+}
+
+#define BOSS_COUNT(field) (boss_counters()->field++)
+
+#else
+
+#define BOSS_COUNT(field) ((void)0)
+
+#endif
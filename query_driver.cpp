@@ -0,0 +1,260 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cctype>
+#include "select_free_boss.hh"
+#include "color_annotation.hh"
+#include "parallel.hh"
+#include "sequence_reader.hh"
+
+using std::string;
+using std::vector;
+
+// Writes the outputs of batches that finish in any order in batch order. At most
+// `capacity` batches can be in flight ahead of the oldest unwritten one, which
+// bounds the memory of reads and results waiting for a slow batch.
+class ReorderBuffer{
+public:
+  ReorderBuffer(std::ostream& out, int64_t capacity) : out(out), capacity(capacity) {}
+
+  // Blocks until batch `id` fits in the buffer
+  void reserve(int64_t id){
+    std::unique_lock<std::mutex> lock(mutex);
+    space.wait(lock, [&](){ return id - next < capacity; });
+  }
+
+  // Stores the output of batch `id` and writes all outputs that are now in order
+  void put(int64_t id, string&& text){
+    std::lock_guard<std::mutex> lock(mutex);
+    ready[id] = std::move(text);
+    while(!ready.empty() && ready.begin()->first == next){
+      out.write(ready.begin()->second.data(), ready.begin()->second.size());
+      ready.erase(ready.begin());
+      next++;
+    }
+    space.notify_all();
+  }
+
+private:
+  std::ostream& out;
+  int64_t capacity;
+  int64_t next = 0; // Next batch to write
+  std::map<int64_t, string> ready;
+  std::mutex mutex;
+  std::condition_variable space;
+};
+
+struct Read{
+  string header;
+  string sequence;
+};
+
+// Writes the numbers as a comma-separated column
+template <typename T>
+void write_numbers(std::ostream& out, const vector<T>& numbers){
+  out << '\t';
+  for(int64_t i = 0; i < (int64_t)numbers.size(); i++) out << (i > 0 ? "," : "") << numbers[i];
+}
+
+// Writes the colors of the k-mers found as a column of color:count pairs, most frequent
+// first, or * if no k-mer was found. A k-mer counts once for each color of its set.
+// Neighbouring k-mers usually share a set, so runs of the same set are counted first.
+void write_colors(std::ostream& out, const ColorAnnotation& colors, const vector<int64_t>& forward, const vector<int64_t>& reverse){
+  std::map<int64_t, int64_t> set_counts;
+  int64_t run_set = -1, run_length = 0;
+  for(int64_t i = 0; i < (int64_t)forward.size(); i++){
+    int64_t rank = forward[i] >= 0 || reverse.empty() ? forward[i] : reverse[i];
+    int64_t set = rank >= 0 ? colors.set_id(rank) : 0;
+    if(set != run_set){
+      if(run_set > 0) set_counts[run_set] += run_length;
+      run_set = set, run_length = 0;
+    }
+    run_length++;
+  }
+  if(run_set > 0) set_counts[run_set] += run_length;
+
+  std::map<int32_t, int64_t> color_counts;
+  for(const auto& set : set_counts)
+    for(int32_t color : colors.color_set(set.first)) color_counts[color] += set.second;
+  vector<std::pair<int64_t, int32_t>> sorted;
+  for(const auto& color : color_counts) sorted.push_back({-color.second, color.first});
+  std::sort(sorted.begin(), sorted.end());
+  out << '\t';
+  if(sorted.empty()) out << '*';
+  for(int64_t i = 0; i < (int64_t)sorted.size(); i++)
+    out << (i > 0 ? "," : "") << colors.color_name(sorted[i].second) << ':' << -sorted[i].first;
+}
+
+// One line per read: the read name, the number of its k-mers found in the index and
+// the number of its k-mers. With `ranks`, the colex ranks of the k-mers follow
+// (-1 for k-mers that are not found). With `strands`, a k-mer counts as found if it or its
+// reverse complement is found. The numbers of k-mers found on the forward and the reverse
+// strand and the strand of the read follow: + or - if more of its k-mers are found on that
+// strand, . otherwise. The ranks are then those of the k-mers and of their reverse complements.
+// With `ms`, the matching statistics of the read follow: for every position, the length of
+// the longest suffix ending there that occurs in the graph, up to k. With `strands`, those
+// of the reverse complement of the read follow in a second column. With `colors`, the last
+// column has the colors of the k-mers found (see write_colors).
+string query_batch(const SelectFreeBOSS& boss, vector<Read>& batch, bool ranks, bool ms, bool strands, const ColorAnnotation* colors){
+  std::ostringstream out;
+  vector<int64_t> forward, reverse;
+  vector<int> forward_lengths, reverse_lengths;
+  // One streaming pass over a strand gives its k-mer ranks and, with `ms`, its matching statistics
+  auto search_strand = [&](const string& sequence, vector<int64_t>& strand_ranks, vector<int>& lengths){
+    if(ms) streaming_search(boss, sequence, strand_ranks, lengths);
+    else strand_ranks = streaming_search(boss, sequence);
+  };
+  for(Read& read : batch){
+    for(char& c : read.sequence) c = toupper(c);
+    out << read.header.substr(0, read.header.find_first_of(" \t"));
+    search_strand(read.sequence, forward, forward_lengths);
+    if(!strands){
+      int64_t found = 0;
+      for(int64_t rank : forward) found += rank >= 0;
+      out << '\t' << found << '\t' << forward.size();
+      if(ranks) write_numbers(out, forward);
+      if(ms) write_numbers(out, forward_lengths);
+      if(colors != nullptr) write_colors(out, *colors, forward, vector<int64_t>());
+    } else {
+      // The reverse complement of the k-mer at i is the k-mer at size-1-i of the reverse complement of the read
+      vector<int64_t> reverse_ranks;
+      search_strand(reverse_complement(read.sequence), reverse_ranks, reverse_lengths);
+      reverse.resize(forward.size());
+      int64_t found = 0, found_forward = 0, found_reverse = 0;
+      for(int64_t i = 0; i < (int64_t)forward.size(); i++){
+        reverse[i] = reverse_ranks[forward.size() - 1 - i];
+        found += forward[i] >= 0 || reverse[i] >= 0;
+        found_forward += forward[i] >= 0;
+        found_reverse += reverse[i] >= 0;
+      }
+      char strand = found_forward > found_reverse ? '+' : found_reverse > found_forward ? '-' : '.';
+      out << '\t' << found << '\t' << forward.size() << '\t' << found_forward << '\t' << found_reverse << '\t' << strand;
+      if(ranks){
+        write_numbers(out, forward);
+        write_numbers(out, reverse);
+      }
+      if(ms){
+        write_numbers(out, forward_lengths);
+        write_numbers(out, reverse_lengths);
+      }
+      if(colors != nullptr) write_colors(out, *colors, forward, reverse);
+    }
+    out << '\n';
+  }
+  return out.str();
+}
+
+// Sums the query counters of the worker threads. Each batch adds the counts of its queries.
+struct CounterTotals{
+  QueryCounters totals = QueryCounters();
+  std::mutex mutex;
+
+  void add(const QueryCounters& before, const QueryCounters& after){
+    std::lock_guard<std::mutex> lock(mutex);
+    totals.queries += after.queries - before.queries;
+    totals.search_steps += after.search_steps - before.search_steps;
+    totals.early_terminations += after.early_terminations - before.early_terminations;
+    totals.rank_calls += after.rank_calls - before.rank_calls;
+    totals.select_calls += after.select_calls - before.select_calls;
+  }
+
+  void print(std::ostream& out) const {
+    double queries = std::max<int64_t>(totals.queries, 1);
+    out << "queries\t" << totals.queries << '\n';
+    out << "search steps\t" << totals.search_steps << "\t" << totals.search_steps / queries << " per query" << '\n';
+    out << "early terminations\t" << totals.early_terminations << "\t" << totals.early_terminations / queries << " per query" << '\n';
+    out << "rank calls\t" << totals.rank_calls << "\t" << totals.rank_calls / queries << " per query" << '\n';
+    out << "select calls\t" << totals.select_calls << "\t" << totals.select_calls / queries << " per query" << '\n';
+  }
+};
+
+int main(int argc, char** argv){
+  int n_threads = std::max<int>(std::thread::hardware_concurrency(), 1);
+  int64_t batch_bases = 1 << 20;
+  bool ranks = false, ms = false, strands = false, counters = false;
+  vector<string> files;
+  string colors_file;
+  for(int i = 1; i < argc; i++){
+    string arg = argv[i];
+    if(arg == "-t" && i + 1 < argc) n_threads = std::max(std::stoi(argv[++i]), 1);
+    else if(arg == "-b" && i + 1 < argc) batch_bases = std::max<int64_t>(std::stoll(argv[++i]), 1);
+    else if(arg == "-c" && i + 1 < argc) colors_file = argv[++i];
+    else if(arg == "--ranks") ranks = true;
+    else if(arg == "--ms") ms = true;
+    else if(arg == "--strands") strands = true;
+    else if(arg == "--counters") counters = true;
+    else files.push_back(arg);
+  }
+  if(files.size() < 2 || files.size() > 3){
+    std::cerr << "Usage: " << argv[0] << " [-t threads] [-b batch_bases] [-c colors] [--ranks] [--ms] [--strands] [--counters] index reads.fasta[.gz] [output]" << '\n';
+    return 1;
+  }
+
+#ifndef BOSS_COUNTERS
+  if(counters){
+    std::cerr << "ERROR: --counters requires compiling with -DBOSS_COUNTERS" << '\n';
+    return 1;
+  }
+#endif
+
+  try{
+    SelectFreeBOSS boss = SelectFreeBOSS::load(files[0]);
+    std::unique_ptr<ColorAnnotation> colors;
+    if(!colors_file.empty()){
+      colors = std::make_unique<ColorAnnotation>(ColorAnnotation::load(colors_file));
+      if(colors->n_nodes != boss.node_count) throw std::runtime_error(colors_file + " does not annotate " + files[0]);
+    }
+    CounterTotals counter_totals;
+    SequenceReader reader(files[1]);
+    std::ofstream output_file;
+    if(files.size() == 3){
+      output_file.open(files[2]);
+      if(!output_file) throw std::runtime_error("Could not open " + files[2] + " for writing");
+    }
+    std::ostream& out = files.size() == 3 ? output_file : std::cout;
+
+    // The reader fills batches of about batch_bases characters and hands each one to the pool
+    ReorderBuffer buffer(out, 4 * n_threads);
+    ThreadPool pool(n_threads);
+    Read read;
+    for(int64_t id = 0; ; id++){
+      auto batch = std::make_shared<vector<Read>>();
+      int64_t bases = 0;
+      while(bases < batch_bases && reader.next_read(read.header, read.sequence)){
+        bases += read.sequence.size();
+        batch->push_back(std::move(read));
+      }
+      if(batch->empty()) break;
+      buffer.reserve(id);
+      pool.submit([&boss, &buffer, &counter_totals, batch, id, ranks, ms, strands, annotation = colors.get()](){
+        try{
+#ifdef BOSS_COUNTERS
+          QueryCounters before = *boss_counters();
+          buffer.put(id, query_batch(boss, *batch, ranks, ms, strands, annotation));
+          counter_totals.add(before, *boss_counters());
+#else
+          buffer.put(id, query_batch(boss, *batch, ranks, ms, strands, annotation));
+#endif
+        } catch(...){
+          buffer.put(id, ""); // Keep the later batches flowing so that the error reaches wait()
+          throw;
+        }
+      });
+    }
+    pool.wait();
+    out.flush();
+    if(!out) throw std::runtime_error("Error writing output");
+    if(counters) counter_totals.print(std::cerr);
+  } catch(const std::exception& e){
+    std::cerr << "ERROR: " << e.what() << '\n';
+    return 1;
+  }
+  return 0;
+}
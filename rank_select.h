@@ -0,0 +1,317 @@
+#pragma once
+
+#include "inttypes.h"
+#include "assert.h"
+#include "stdlib.h"
+#include "string.h"
+#include "index_file.h"
+#include "popcount.h"
+#include "rrr_vector.h"
+#include "query_counters.h"
+
+// Packed bit vectors and DNA strings with rank and select support.
+// Written in the common subset of C and C++ so that both kinds of programs can include it.
+
+#define PACKED_BLOCK_BITS 512 // Rank directory granularity (8 words)
+#define PACKED_SELECT_SAMPLE 1024 // Every PACKED_SELECT_SAMPLE-th occurrence of each bit value is sampled
+
+typedef struct PackedBitVector{
+
+    uint64_t* words;
+    int64_t* block_ranks; // Number of ones before each block. Has n_blocks + 1 entries.
+    int64_t* select1_samples; // Block containing the (i*PACKED_SELECT_SAMPLE+1)-th one
+    int64_t* select0_samples; // Block containing the (i*PACKED_SELECT_SAMPLE+1)-th zero
+    int64_t n_bits;
+    int64_t n_blocks;
+    int64_t n_ones;
+    int compressed; // If set, only rrr and the sizes are valid
+    RRRVector rrr;
+
+} PackedBitVector;
+
+
+// Number of occurrences of bit value `symbol` in blocks [0..b)
+static inline int64_t blocks_rank(const PackedBitVector* B, char symbol, int64_t b){
+    if(symbol == '1') return B->block_ranks[b];
+    else return b * PACKED_BLOCK_BITS - B->block_ranks[b];
+}
+
+// Allocates a bit vector of n_bits zeros. Set the ones with PackedBitVector_set and
+// then call PackedBitVector_init_support before the first query.
+static inline PackedBitVector PackedBitVector_new(int64_t n_bits){
+    PackedBitVector B;
+    B.n_bits = n_bits;
+    B.n_blocks = (B.n_bits + PACKED_BLOCK_BITS - 1) / PACKED_BLOCK_BITS;
+    B.words = (uint64_t*)calloc(B.n_blocks * (PACKED_BLOCK_BITS / 64) + 1, sizeof(uint64_t));
+    B.block_ranks = NULL;
+    B.select1_samples = NULL;
+    B.select0_samples = NULL;
+    B.n_ones = 0;
+    B.compressed = 0;
+    return B;
+}
+
+static inline void PackedBitVector_set(PackedBitVector* B, int64_t i){
+    B->words[i >> 6] |= (uint64_t)1 << (i & 63);
+}
+
+// Builds the rank and select directories
+static inline void PackedBitVector_init_support(PackedBitVector* B){
+    free(B->block_ranks);
+    free(B->select1_samples);
+    free(B->select0_samples);
+    B->block_ranks = (int64_t*)malloc((B->n_blocks + 1) * sizeof(int64_t));
+    B->n_ones = 0;
+    for(int64_t b = 0; b < B->n_blocks; b++){
+        B->block_ranks[b] = B->n_ones;
+        B->n_ones += popcount_prefix(B->words + b * (PACKED_BLOCK_BITS / 64), PACKED_BLOCK_BITS);
+    }
+    B->block_ranks[B->n_blocks] = B->n_ones;
+
+    int64_t n_zeros = B->n_bits - B->n_ones;
+    B->select1_samples = (int64_t*)malloc((B->n_ones / PACKED_SELECT_SAMPLE + 2) * sizeof(int64_t));
+    B->select0_samples = (int64_t*)malloc((n_zeros / PACKED_SELECT_SAMPLE + 2) * sizeof(int64_t));
+    int64_t ones_seen = 0;
+    for(int64_t i = 0; i < B->n_bits; i++){
+        int64_t bit = (B->words[i >> 6] >> (i & 63)) & 1;
+        int64_t seen = bit ? ones_seen : i - ones_seen; // Occurrences of this bit value before i
+        if(seen % PACKED_SELECT_SAMPLE == 0){
+            if(bit) B->select1_samples[seen / PACKED_SELECT_SAMPLE] = i / PACKED_BLOCK_BITS;
+            else B->select0_samples[seen / PACKED_SELECT_SAMPLE] = i / PACKED_BLOCK_BITS;
+        }
+        ones_seen += bit;
+    }
+    // Sentinels so that the next sample always exists
+    B->select1_samples[(B->n_ones + PACKED_SELECT_SAMPLE - 1) / PACKED_SELECT_SAMPLE] = B->n_blocks - 1;
+    B->select0_samples[(n_zeros + PACKED_SELECT_SAMPLE - 1) / PACKED_SELECT_SAMPLE] = B->n_blocks - 1;
+}
+
+// Builds the bit vector from a string of digits '0' and '1'
+static inline PackedBitVector PackedBitVector_from_digits(const char* digits){
+    PackedBitVector B = PackedBitVector_new(strlen(digits));
+    for(int64_t i = 0; i < B.n_bits; i++)
+        if(digits[i] == '1') PackedBitVector_set(&B, i);
+    PackedBitVector_init_support(&B);
+    return B;
+}
+
+// Replaces the plain representation with an RRR compressed one. Queries get slower.
+static inline void PackedBitVector_compress(PackedBitVector* B){
+    if(B->compressed) return;
+    B->rrr = RRR_from_words(B->words, B->n_bits);
+    free(B->words);
+    free(B->block_ranks);
+    free(B->select1_samples);
+    free(B->select0_samples);
+    B->words = NULL;
+    B->block_ranks = B->select1_samples = B->select0_samples = NULL;
+    B->compressed = 1;
+}
+
+// Size of the arrays in bytes
+static inline int64_t PackedBitVector_size_in_bytes(const PackedBitVector* B){
+    if(B->compressed) return RRR_size_in_bytes(&B->rrr);
+    return (B->n_blocks * (PACKED_BLOCK_BITS / 64) + 1 + B->n_blocks + 1
+            + B->n_ones / PACKED_SELECT_SAMPLE + 2 + (B->n_bits - B->n_ones) / PACKED_SELECT_SAMPLE + 2) * 8;
+}
+
+static inline void PackedBitVector_free(PackedBitVector* B){
+    if(B->compressed){
+        RRR_free(&B->rrr);
+        return;
+    }
+    free(B->words);
+    free(B->block_ranks);
+    free(B->select1_samples);
+    free(B->select0_samples);
+}
+
+static inline void PackedBitVector_write(FILE* f, const PackedBitVector* B){
+    int64_t n_zeros = B->n_bits - B->n_ones;
+    index_write_scalar(f, B->compressed);
+    if(B->compressed){
+        RRR_write(f, &B->rrr);
+        return;
+    }
+    index_write_scalar(f, B->n_bits);
+    index_write_scalar(f, B->n_blocks);
+    index_write_scalar(f, B->n_ones);
+    index_write_array(f, B->words, (B->n_blocks * (PACKED_BLOCK_BITS / 64) + 1) * sizeof(uint64_t));
+    index_write_array(f, B->block_ranks, (B->n_blocks + 1) * sizeof(int64_t));
+    index_write_array(f, B->select1_samples, (B->n_ones / PACKED_SELECT_SAMPLE + 2) * sizeof(int64_t));
+    index_write_array(f, B->select0_samples, (n_zeros / PACKED_SELECT_SAMPLE + 2) * sizeof(int64_t));
+}
+
+// The arrays point into the mapping and must not be freed
+static inline PackedBitVector PackedBitVector_map(IndexFile* file){
+    PackedBitVector B;
+    int64_t n_bytes;
+    B.compressed = index_read_scalar(file) != 0;
+    if(B.compressed){
+        B.rrr = RRR_map(file);
+        B.n_bits = B.rrr.n_bits;
+        B.n_ones = B.rrr.n_ones;
+        B.n_blocks = 0;
+        B.words = NULL;
+        B.block_ranks = B.select1_samples = B.select0_samples = NULL;
+        return B;
+    }
+    B.n_bits = index_read_scalar(file);
+    B.n_blocks = index_read_scalar(file);
+    B.n_ones = index_read_scalar(file);
+    B.words = (uint64_t*)index_read_array(file, &n_bytes);
+    B.block_ranks = (int64_t*)index_read_array(file, &n_bytes);
+    B.select1_samples = (int64_t*)index_read_array(file, &n_bytes);
+    B.select0_samples = (int64_t*)index_read_array(file, &n_bytes);
+    return B;
+}
+
+static inline int64_t Access(const PackedBitVector* B, int64_t position){
+    if(B->compressed) return RRR_Access(&B->rrr, position);
+    return (B->words[position >> 6] >> (position & 63)) & 1;
+}
+
+// Counts the number of occurrence of symbol ('0' or '1') in array[0..position)
+static inline int64_t Rank(const PackedBitVector* B, char symbol, int64_t position){
+    BOSS_COUNT(rank_calls);
+    if(B->compressed) return RRR_Rank(&B->rrr, symbol, position);
+    int64_t block = position / PACKED_BLOCK_BITS;
+    int64_t ones = B->block_ranks[block] + popcount_prefix(B->words + block * (PACKED_BLOCK_BITS / 64), position - block * PACKED_BLOCK_BITS);
+    return symbol == '1' ? ones : position - ones;
+}
+
+// Returns position i such that array[i] == symbol and
+// symbol occurs `count` times in array[0..i]
+// Using capital S in the name because select conflicts with the standard library
+static inline int64_t Select(const PackedBitVector* B, char symbol, int64_t count){
+    assert(count >= 1 && count <= (symbol == '1' ? B->n_ones : B->n_bits - B->n_ones));
+    BOSS_COUNT(select_calls);
+    if(B->compressed) return RRR_Select(&B->rrr, symbol, count);
+    const int64_t* samples = symbol == '1' ? B->select1_samples : B->select0_samples;
+
+    // The answer is in a block between two consecutive samples. Binary search for the
+    // last block that has fewer than `count` occurrences before it.
+    int64_t lo = samples[(count - 1) / PACKED_SELECT_SAMPLE];
+    int64_t hi = samples[(count - 1) / PACKED_SELECT_SAMPLE + 1];
+    while(lo < hi){
+        int64_t mid = lo + (hi - lo + 1) / 2;
+        if(blocks_rank(B, symbol, mid) < count) lo = mid;
+        else hi = mid - 1;
+    }
+
+    // Scan the words of the block
+    const uint64_t* planes[1] = {B->words};
+    return match_select(planes, 1, 1, symbol == '1', lo * (PACKED_BLOCK_BITS / 64), count - blocks_rank(B, symbol, lo));
+}
+
+// DNA string over {A,C,G,T} packed into 2 bits per character with per-block
+// occurrence counts of all four characters, so that Rank is constant time.
+typedef struct PackedDNA{
+
+    uint64_t* lo_bits; // Lower bit of the 2-bit code of each character
+    uint64_t* hi_bits; // Higher bit of the 2-bit code of each character
+    int64_t* block_counts; // Occurrences of each character before each block, 4 entries per block
+    int64_t length;
+
+} PackedDNA;
+
+static inline int64_t DNA_to_code(char c){
+    switch(c){
+        case 'A': return 0;
+        case 'C': return 1;
+        case 'G': return 2;
+        case 'T': return 3;
+        default: return -1;
+    }
+}
+
+// Allocates a string of `length` A's. Set the characters with PackedDNA_set and then
+// call PackedDNA_init_counts before the first query.
+static inline PackedDNA PackedDNA_new(int64_t length){
+    PackedDNA P;
+    P.length = length;
+    int64_t n_blocks = P.length / PACKED_BLOCK_BITS + 1;
+    int64_t n_words = n_blocks * (PACKED_BLOCK_BITS / 64);
+    P.lo_bits = (uint64_t*)calloc(n_words, sizeof(uint64_t));
+    P.hi_bits = (uint64_t*)calloc(n_words, sizeof(uint64_t));
+    P.block_counts = (int64_t*)calloc(4 * (n_blocks + 1), sizeof(int64_t));
+    return P;
+}
+
+// Sets S[i] to the character with the given 2-bit code. S[i] must still be 'A'.
+static inline void PackedDNA_set(PackedDNA* P, int64_t i, int64_t code){
+    if(code & 1) P->lo_bits[i >> 6] |= (uint64_t)1 << (i & 63);
+    if(code & 2) P->hi_bits[i >> 6] |= (uint64_t)1 << (i & 63);
+}
+
+static inline void PackedDNA_init_counts(PackedDNA* P){
+    int64_t n_blocks = P->length / PACKED_BLOCK_BITS + 1;
+    for(int64_t b = 0; b < n_blocks; b++){
+        const uint64_t* planes[2] = {P->lo_bits + b * (PACKED_BLOCK_BITS / 64), P->hi_bits + b * (PACKED_BLOCK_BITS / 64)};
+        int64_t n_chars = P->length - b * PACKED_BLOCK_BITS < PACKED_BLOCK_BITS ? P->length - b * PACKED_BLOCK_BITS : PACKED_BLOCK_BITS;
+        for(int64_t code = 0; code < 4; code++)
+            P->block_counts[4 * (b + 1) + code] = P->block_counts[4 * b + code] + match_prefix(planes, 2, 1, code, n_chars);
+    }
+}
+
+static inline PackedDNA PackedDNA_from_string(const char* S){
+    PackedDNA P = PackedDNA_new(strlen(S));
+    for(int64_t i = 0; i < P.length; i++){
+        int64_t code = DNA_to_code(S[i]);
+        assert(code >= 0);
+        PackedDNA_set(&P, i, code);
+    }
+    PackedDNA_init_counts(&P);
+    return P;
+}
+
+static inline void PackedDNA_free(PackedDNA* P){
+    free(P->lo_bits);
+    free(P->hi_bits);
+    free(P->block_counts);
+}
+
+static inline void PackedDNA_write(FILE* f, const PackedDNA* P){
+    int64_t n_blocks = P->length / PACKED_BLOCK_BITS + 1;
+    index_write_scalar(f, P->length);
+    index_write_array(f, P->lo_bits, n_blocks * (PACKED_BLOCK_BITS / 64) * sizeof(uint64_t));
+    index_write_array(f, P->hi_bits, n_blocks * (PACKED_BLOCK_BITS / 64) * sizeof(uint64_t));
+    index_write_array(f, P->block_counts, 4 * (n_blocks + 1) * sizeof(int64_t));
+}
+
+// The arrays point into the mapping and must not be freed
+static inline PackedDNA PackedDNA_map(IndexFile* file){
+    PackedDNA P;
+    int64_t n_bytes;
+    P.length = index_read_scalar(file);
+    P.lo_bits = (uint64_t*)index_read_array(file, &n_bytes);
+    P.hi_bits = (uint64_t*)index_read_array(file, &n_bytes);
+    P.block_counts = (int64_t*)index_read_array(file, &n_bytes);
+    return P;
+}
+
+// Counts the number of occurrence of symbol in S[0..position)
+static inline int64_t DNA_Rank(const PackedDNA* P, char symbol, int64_t position){
+    BOSS_COUNT(rank_calls);
+    int64_t code = DNA_to_code(symbol);
+    if(code < 0) return 0;
+    int64_t block = position / PACKED_BLOCK_BITS;
+    const uint64_t* planes[2] = {P->lo_bits + block * (PACKED_BLOCK_BITS / 64), P->hi_bits + block * (PACKED_BLOCK_BITS / 64)};
+    return P->block_counts[4 * block + code] + match_prefix(planes, 2, 1, code, position - block * PACKED_BLOCK_BITS);
+}
+
+// Returns the position of the count-th (1-based) occurrence of symbol. There are no select
+// samples, so the block is found by binary search over the block counts.
+static inline int64_t DNA_Select(const PackedDNA* P, char symbol, int64_t count){
+    BOSS_COUNT(select_calls);
+    int64_t code = DNA_to_code(symbol);
+    assert(code >= 0 && count >= 1);
+    int64_t lo = 0, hi = P->length / PACKED_BLOCK_BITS;
+    while(lo < hi){ // Last block with fewer than count occurrences before it
+        int64_t mid = lo + (hi - lo + 1) / 2;
+        if(P->block_counts[4 * mid + code] < count) lo = mid;
+        else hi = mid - 1;
+    }
+    const uint64_t* planes[2] = {P->lo_bits, P->hi_bits};
+    return match_select(planes, 2, 1, code, lo * (PACKED_BLOCK_BITS / 64), count - P->block_counts[4 * lo + code]);
+}
@@ -1,188 +1,476 @@
-#include <iostream>
-#include <set>
-#include <vector>
-#include <map>
-#include <string>
-#include <cassert>
-#include <algorithm>
-#include "stdlib_printing.hh"
-
-using std::string;
-using std::vector;
-using std::map;
-using std::set;
-using std::cout;
-
-class SelectFreeBOSS{
-public:
-  SelectFreeBOSS(const vector<string>& input, int k);
-  // One bit vector for each character. Can be empty bit vector if the character does not occur
-  string SBWT[256];
-  // SBWT['A'], SBWT['C'], SBWT['G'], SBWT['T'] are all bit vectors
-  vector<int> C; // C-array (cumulative character counts)
-  int node_count;
-};
-
-// true if S is colexicographically-smaller than T
-bool colex_compare(const string& S, const string& T) {
-  for (int i_s = S.size() - 1, i_t = T.size() - 1;; --i_s, --i_t){
-    // One of the strings is a suffix of the other. Return the shorter.
-    if(i_s < 0 || i_t < 0) return S.size() < T.size();
-    if(S[i_s] != T[i_t]) return S[i_s] < T[i_t];
-  }
-}
+#include "select_free_boss.hh"
+#include "dynamic_boss.hh"
+#include "color_annotation.hh"
+#include "unitigs.hh"
+#include "merge_boss.hh"
+#include <fstream>
+#include <sstream>
+#include <random>
 
-// Counts the number of occurrence of symbol in array[0..position)
-int64_t rank(const string& S, char symbol, int64_t position){
-  int64_t ans = 0;
-  for(int64_t i = 0; i < position; ++i)
-    if(S[i] == symbol) ++ans;
-  return ans;
+set<string, decltype(colex_compare)*> extract_kmers(vector<string>& input, int k) {
+  set<string, decltype(colex_compare)*> kmers(colex_compare);
+  for(string& S : input)
+    for(int i = 0; i + k <= (int64_t)S.size(); i++)
+      kmers.insert(S.substr(i,k));
+  return kmers;
 }
 
-// Returns position i such that array[i] == symbol and
-// symbol occurs `count` times in array[0..i]
-int64_t select(const string& S, char symbol, int64_t count){
-  int64_t occurrences_seen = 0;
-  for(int64_t i = 0; i < S.size(); ++i){
-    if(S[i] == symbol) occurrences_seen++;
-    if(occurrences_seen == count) return i;
+int main(int argc, char** argv){
+  if(argc == 5 && string(argv[1]) == "--merge"){ // select_free_boss --merge a.index b.index output.index
+    construction_dump = false;
+    try{
+      SelectFreeBOSS merged = merge_boss(SelectFreeBOSS::load(argv[2]), SelectFreeBOSS::load(argv[3]), std::thread::hardware_concurrency());
+      cout << index_stats(merged);
+      merged.save(argv[4]);
+      return 0;
+    } catch(const std::exception& e){
+      std::cerr << "ERROR: " << e.what() << '\n';
+      return 1;
+    }
+  }
+  if(argc >= 2){ // select_free_boss input.fasta[.gz] k [output.index] [-p prefix_length] [--interleaved | --compressed] [--minimal-dummies] [--both-strands] [--colors output.colors]
+      // [--unitigs output.fasta] [--gfa output.gfa] [--lcs]
+    vector<string> args;
+    string colors_file, unitigs_file, gfa_file;
+    int prefix_length = 0;
+    bool interleaved = false, compressed = false, minimal_dummies = false, both_strands = false, with_lcs = false;
+    for(int i = 1; i < argc; i++){
+      string arg = argv[i];
+      if(arg == "-p" && i + 1 < argc) prefix_length = atoi(argv[++i]);
+      else if(arg == "--interleaved") interleaved = true;
+      else if(arg == "--compressed") compressed = true;
+      else if(arg == "--minimal-dummies") minimal_dummies = true;
+      else if(arg == "--both-strands") both_strands = true;
+      else if(arg == "--lcs") with_lcs = true;
+      else if(arg == "--colors" && i + 1 < argc) colors_file = argv[++i];
+      else if(arg == "--unitigs" && i + 1 < argc) unitigs_file = argv[++i];
+      else if(arg == "--gfa" && i + 1 < argc) gfa_file = argv[++i];
+      else args.push_back(arg);
+    }
+    if(args.size() < 2 || args.size() > 3){
+      std::cerr << "Usage: " << argv[0] << " input.fasta[.gz] k [output.index] [-p prefix_length] [--interleaved | --compressed] [--minimal-dummies]"
+                << " [--both-strands] [--colors output.colors] [--unitigs output.fasta] [--gfa output.gfa] [--lcs]" << '\n';
+      return 1;
+    }
+    if(interleaved && compressed){
+      std::cerr << "ERROR: --interleaved and --compressed are different layouts, give at most one" << '\n';
+      return 1;
+    }
+    int64_t k = 0;
+    size_t k_end = 0;
+    try{ k = std::stoll(args[1], &k_end); } catch(const std::exception&){}
+    if(k_end != args[1].size() || k < 1 || k > 64){
+      std::cerr << "ERROR: k must be an integer from 1 to 64, got " << args[1] << '\n';
+      return 1;
+    }
+    try{
+      SequenceReader reader(args[0]);
+      construction_dump = false;
+      SelectFreeBOSS boss(reader, (int)k, std::thread::hardware_concurrency(), 1 << 28, minimal_dummies, both_strands, with_lcs);
+      if(minimal_dummies) cout << "Redundant dummies removed: " << boss.removed_dummies << '\n';
+      if(prefix_length > 0) boss.build_prefix_table(prefix_length, std::thread::hardware_concurrency());
+      if(interleaved) boss.set_layout(SelectFreeBOSS::INTERLEAVED);
+      if(compressed) boss.set_layout(SelectFreeBOSS::COMPRESSED);
+      IndexStats stats = index_stats(boss);
+      if(!colors_file.empty()){ // One color per record of the input
+        SequenceReader color_reader(args[0]);
+        ColorAnnotation colors(boss, color_reader, std::thread::hardware_concurrency());
+        colors.add_to_stats(stats);
+        cout << "Colors: " << colors.n_colors << ", distinct color sets: " << colors.n_sets << '\n';
+        colors.save(colors_file);
+      }
+      cout << stats;
+      if(!unitigs_file.empty() || !gfa_file.empty()){
+        vector<Unitig> unitigs = extract_unitigs(boss, std::thread::hardware_concurrency());
+        cout << "unitigs\t" << unitigs.size() << '\n';
+        for(int gfa = 0; gfa < 2; gfa++){
+          const string& file = gfa ? gfa_file : unitigs_file;
+          if(file.empty()) continue;
+          std::ofstream out(file);
+          if(gfa) write_unitigs_gfa(out, boss, unitigs);
+          else write_unitigs_fasta(out, unitigs);
+          if(!out.flush()){
+            std::cerr << "ERROR: could not write " << file << '\n';
+            return 1;
+          }
+        }
+      }
+      if(args.size() >= 3) boss.save(args[2]);
+      return 0;
+    } catch(const std::exception& e){
+      std::cerr << "ERROR: " << e.what() << '\n';
+      return 1;
+    }
   }
-  throw std::range_error("Select reached end of string before finding the requested number of symbols");
-}
 
-vector<int> cumulative_sum_of_counts(const vector<int>& counts) {
-  vector<int> C(counts);
-  for (int i = 1; i < C.size(); ++i)
-    C[i] += C[i-1];
-  return C;
-}
+  vector<string> input = {"GAAGCCGCCATTCCATAGTGAGTCCTTCGTCTGTGACTATCTGTGCCAGATCGTCTAGCAAACTGCTGATCCAGTTTATCTCACCAAATTATAGCCGTACAGACCGAAATCTTAAGTCATATCACGCGACTAGGCTCAGCTTTATTTTTGTGGTCATGGGTTTTGGTCCGCCCGAGCGGTGCAGCCGATTAGGACCATGT"};
+  int k = 4;
+  SelectFreeBOSS boss(input, k, std::thread::hardware_concurrency());
+  auto kmers = extract_kmers(input, k);
+  for(string kmer : kmers)
+    cout << search(boss, kmer) << '\n';
 
-template <typename T>
-inline void shift_vector_to_the_right_by_1(vector<T>& v){
-  for(int i = v.size() - 1; i > 0; --i)
-    v[i] = v[i-1];
-  v[0] = 0;
-}
+  // Check that batched search agrees with one-at-a-time search, including on absent k-mers
+  vector<string> queries(kmers.begin(), kmers.end());
+  for(string kmer : kmers){
+    std::reverse(kmer.begin(), kmer.end());
+    queries.push_back(kmer);
+  }
+  vector<int64_t> batch_results = search_batch(boss, queries);
+  for(int64_t i = 0; i < (int64_t)queries.size(); i++)
+    if(batch_results[i] != search(boss, queries[i]))
+      cout << "ERROR: batched search returned a different answer for k-mer " << queries[i] << '\n';
 
-vector<int> construct_C(const vector<int>& counts){
-  vector<int> C = cumulative_sum_of_counts(counts);
-  shift_vector_to_the_right_by_1(C); // we shift to follow the definition
-  return C;
-}
+  // Check that streaming search over a read agrees with searching each k-mer separately
+  string read = input[0] + "N" + string(input[0].rbegin(), input[0].rend());
+  vector<int64_t> streaming_results = streaming_search(boss, read);
+  for(int64_t i = 0; i + k <= (int64_t)read.size(); i++)
+    if(streaming_results[i] != search(boss, read.substr(i, k)))
+      cout << "ERROR: streaming search returned a different answer at position " << i << '\n';
 
-// Edge-centric definition.
-// k is the length of node labels.
-SelectFreeBOSS::SelectFreeBOSS(const vector<string>& input, int k){
-  map<string, std::pair<set<char>, set<char>>, decltype(colex_compare)*> kmers(colex_compare); // k-mer -> (incoming labels, outgoing labels)
+  // Check the matching statistics against the substrings of the k-mers of the input, on the
+  // read and on the contigs, the latter also on the index without redundant dummies below
+  auto check_matching_statistics = [&](const SelectFreeBOSS& index, const vector<string>& indexed, const string& S, const string& name){
+    set<string> substrings;
+    for(const string& T : indexed)
+      for(int64_t i = 0; i + k <= (int64_t)T.size(); i++)
+        for(int64_t length = 1; length <= k; length++) substrings.insert(T.substr(i, length));
+    vector<int> lengths = matching_statistics(index, S), one_pass_lengths;
+    vector<int64_t> one_pass_ranks;
+    streaming_search(index, S, one_pass_ranks, one_pass_lengths);
+    if(one_pass_ranks != streaming_search(index, S) || one_pass_lengths != lengths)
+      cout << "ERROR: the one-pass search differs from separate passes in " << name << '\n';
+    for(int64_t i = 0; i < (int64_t)S.size(); i++){
+      int64_t expected = 0;
+      while(expected < std::min<int64_t>(k, i + 1) && substrings.count(S.substr(i - expected, expected + 1))) expected++;
+      if(lengths[i] != expected)
+        cout << "ERROR: matching statistic " << lengths[i] << " instead of " << expected << " at position " << i << " in " << name << '\n';
+    }
+  };
+  check_matching_statistics(boss, input, read, "the read");
 
-  // TODO: ensure that root node exists
-  // TODO: avoid adding redundant dummies
+  // Check that the index with the LCS array gives the same answers and suffix groups as the
+  // one without, also after saving and loading, with ceil(log2(k+1)) bits per entry
+  SelectFreeBOSS with_lcs = SelectFreeBOSS::from_node_list(construct_node_list<uint64_t>(input, k), k, 2, false, true);
+  with_lcs.save("select_free_boss_test.index");
+  SelectFreeBOSS with_lcs_loaded = SelectFreeBOSS::load("select_free_boss_test.index");
+  if(boss.has_lcs() || !with_lcs_loaded.has_lcs() || with_lcs_loaded.LCS.width != 3
+     || streaming_search(with_lcs_loaded, read) != streaming_results || matching_statistics(with_lcs_loaded, read) != matching_statistics(boss, read))
+    cout << "ERROR: the index with the LCS array returned different answers" << '\n';
+  for(int64_t i = 1; i < boss.node_count; i++)
+    if(with_lcs_loaded.same_suffix_group_as_previous(i) != boss.same_suffix_group_as_previous(i))
+      cout << "ERROR: the suffix groups of node " << i << " differ without the LCS array" << '\n';
+  check_matching_statistics(with_lcs_loaded, input, read, "the index with the LCS array");
 
-  for(const string& S : input){
-    assert(S.size() >= k);
+  // Check that searches starting from the prefix table give the same answers, also after
+  // saving and loading. The table covers from part of a k-mer up to the whole k-mer.
+  string filename = "select_free_boss_test.index";
+  SelectFreeBOSS with_table = boss;
+  for(int p = 1; p <= k; p++){
+    with_table.build_prefix_table(p);
+    with_table.save(filename);
+    SelectFreeBOSS loaded = SelectFreeBOSS::load(filename);
+    vector<int64_t> table_batch_results = search_batch(loaded, queries);
+    vector<int64_t> table_streaming_results = streaming_search(loaded, read);
+    for(int64_t i = 0; i < (int64_t)queries.size(); i++)
+      if(search(loaded, queries[i]) != batch_results[i] || table_batch_results[i] != batch_results[i])
+        cout << "ERROR: search with a prefix table of length " << p << " returned a different answer for k-mer " << queries[i] << '\n';
+    if(table_streaming_results != streaming_results)
+      cout << "ERROR: streaming search with a prefix table of length " << p << " returned different answers" << '\n';
+  }
 
-    // Dummies
-    for(int i = 0; i <= k; i++){
-      string prefix = string(k-i, '$') + S.substr(0,i);
-      if(i != 0) kmers[prefix].first.insert('$'); // In
-      if(i < k) kmers[prefix].second.insert(S[i]); // Out
-    }
+  // Check that the interleaved layout gives the same answers, also after saving and loading
+  SelectFreeBOSS interleaved = boss;
+  interleaved.set_layout(SelectFreeBOSS::INTERLEAVED);
+  interleaved.save(filename);
+  SelectFreeBOSS loaded_interleaved = SelectFreeBOSS::load(filename);
+  if(search_batch(interleaved, queries) != batch_results || search_batch(loaded_interleaved, queries) != batch_results
+     || streaming_search(loaded_interleaved, read) != streaming_results)
+    cout << "ERROR: the interleaved layout returned different answers" << '\n';
+  for(string kmer : queries)
+    if(search(loaded_interleaved, kmer) != search(boss, kmer))
+      cout << "ERROR: the interleaved layout returned a different answer for k-mer " << kmer << '\n';
+  interleaved.set_layout(SelectFreeBOSS::SPLIT);
+  for(int64_t i = 0; i < boss.node_count; i++)
+    if(interleaved.out_edges(i) != boss.out_edges(i))
+      cout << "ERROR: converting back to the split layout changed node " << i << '\n';
+
+  // Check that the compressed layout gives the same answers, also after saving and loading,
+  // and drops the LCS array
+  SelectFreeBOSS compressed = with_lcs;
+  compressed.set_layout(SelectFreeBOSS::COMPRESSED);
+  compressed.save(filename);
+  SelectFreeBOSS loaded_compressed = SelectFreeBOSS::load(filename);
+  if(search_batch(compressed, queries) != batch_results || search_batch(loaded_compressed, queries) != batch_results
+     || streaming_search(loaded_compressed, read) != streaming_results || loaded_compressed.has_lcs())
+    cout << "ERROR: the compressed layout returned different answers" << '\n';
+  for(int64_t i = 0; i < boss.node_count; i++)
+    if(loaded_compressed.out_edges(i) != boss.out_edges(i))
+      cout << "ERROR: the compressed layout changed node " << i << '\n';
+
+  // Check that the index without redundant dummies gives the same answers on overlapping
+  // contigs, where only the root and the dummies of the first contig are needed
+  vector<string> contigs;
+  for(int64_t i = 0; i + 20 <= (int64_t)input[0].size(); i += 10) contigs.push_back(input[0].substr(i, 20));
+  vector<KmerNode<uint64_t>> contig_nodes = construct_node_list<uint64_t>(contigs, k);
+  SelectFreeBOSS all_dummies = SelectFreeBOSS::from_node_list(contig_nodes, k, 1, false);
+  int64_t removed = remove_redundant_dummies(contig_nodes, k);
+  SelectFreeBOSS minimal_dummies = SelectFreeBOSS::from_node_list(contig_nodes, k, 1, false);
+  if(minimal_dummies.node_count != (int64_t)extract_kmers(contigs, k).size() + k || minimal_dummies.node_count + removed != all_dummies.node_count)
+    cout << "ERROR: removed " << removed << " dummies from " << contigs.size() << " overlapping contigs" << '\n';
+  for(const string& kmer : queries)
+    if((search(minimal_dummies, kmer) >= 0) != (search(all_dummies, kmer) >= 0))
+      cout << "ERROR: the index without redundant dummies returned a wrong answer for k-mer " << kmer << '\n';
+  check_matching_statistics(minimal_dummies, contigs, read, "the index without redundant dummies");
 
-    // Non-dummies
-    for(int i = 0; i < S.size()-k+1; i++){
-      string kmer = S.substr(i,k);
-      if(i > 0) kmers[kmer].first.insert(S[i-1]); // In
-      if(i + k < S.size()) kmers[kmer].second.insert(S[i+k]); // Out
+  // Check the searches of a k-mer together with its reverse complement against separate
+  // searches, and the index of both strands against the k-mers of both strands
+  vector<std::pair<int64_t, int64_t>> pair_results = search_batch_both_strands(boss, queries);
+  for(int64_t i = 0; i < (int64_t)queries.size(); i++){
+    std::pair<int64_t, int64_t> expected = {search(boss, queries[i]), search(boss, reverse_complement(queries[i]))};
+    if(search_both_strands(boss, queries[i]) != expected || pair_results[i] != expected)
+      cout << "ERROR: search on both strands returned a different answer for k-mer " << queries[i] << '\n';
+  }
+  vector<std::pair<int64_t, int64_t>> strand_results = streaming_search_both_strands(boss, read);
+  for(int64_t i = 0; i + k <= (int64_t)read.size(); i++)
+    if(strand_results[i] != search_both_strands(boss, read.substr(i, k)))
+      cout << "ERROR: streaming search on both strands returned a different answer at position " << i << '\n';
+  SelectFreeBOSS both_strands = SelectFreeBOSS::from_node_list(construct_node_list<uint64_t>(input, k, 2, true), k, 1, false);
+  both_strands.both_strands = true;
+  both_strands.save(filename);
+  SelectFreeBOSS both_strands_loaded = SelectFreeBOSS::load(filename);
+  auto kmers_of_both_strands = extract_kmers(input, k);
+  for(const string& kmer : kmers) kmers_of_both_strands.insert(reverse_complement(kmer));
+  if(!both_strands_loaded.both_strands) cout << "ERROR: the loaded index lost its both_strands flag" << '\n';
+  for(const string& kmer : queries)
+    for(const string& query : {kmer, reverse_complement(kmer)})
+      if((search(both_strands_loaded, query) >= 0) != (kmers_of_both_strands.count(query) > 0))
+        cout << "ERROR: the index of both strands returned a wrong answer for k-mer " << query << '\n';
+
+  // Check the colors of every k-mer against the union of the colors of the contigs that
+  // contain it, also after saving and loading, and on the index of both strands
+  vector<int32_t> contig_colors;
+  std::map<string, set<int32_t>> expected_colors, expected_colors_of_both_strands;
+  for(int64_t i = 0; i < (int64_t)contigs.size(); i++){
+    contig_colors.push_back(i % 3);
+    for(int64_t j = 0; j + k <= (int64_t)contigs[i].size(); j++){
+      expected_colors[contigs[i].substr(j, k)].insert(i % 3);
+      expected_colors_of_both_strands[contigs[i].substr(j, k)].insert(i % 3);
+      expected_colors_of_both_strands[reverse_complement(contigs[i].substr(j, k))].insert(i % 3);
+    }
+  }
+  string colors_filename = "select_free_boss_test.colors";
+  ColorAnnotation(boss, contigs, contig_colors, 2).save(colors_filename);
+  ColorAnnotation loaded_colors = ColorAnnotation::load(colors_filename);
+  ColorAnnotation colors_of_both_strands(both_strands_loaded, contigs, contig_colors, 2);
+  for(const string& kmer : queries){
+    for(const string& query : {kmer, reverse_complement(kmer)}){
+      ColorSet found = search_colors(boss, loaded_colors, query);
+      ColorSet found_of_both_strands = search_colors(both_strands_loaded, colors_of_both_strands, query);
+      if(set<int32_t>(found.begin(), found.end()) != expected_colors[query]
+         || set<int32_t>(found_of_both_strands.begin(), found_of_both_strands.end()) != expected_colors_of_both_strands[query])
+        cout << "ERROR: wrong colors for k-mer " << query << '\n';
     }
   }
+  if(loaded_colors.n_colors != 3 || loaded_colors.n_sets > 8 || loaded_colors.node_colors(0).size() != 0)
+    cout << "ERROR: wrong color set table with " << loaded_colors.n_sets << " sets" << '\n';
 
-  this->node_count = kmers.size();
+  // Check that reading the records in batches of a few contigs gives the same sets, with
+  // the same ids, as one batch of all records, each with its own color
+  {
+    std::ofstream contigs_file(colors_filename);
+    for(int64_t i = 0; i < (int64_t)contigs.size(); i++) contigs_file << ">contig" << i << '\n' << contigs[i] << '\n';
+  }
+  SequenceReader contigs_reader(colors_filename);
+  ColorAnnotation batched_colors(boss, contigs_reader, 2, 50);
+  vector<int32_t> record_colors(contigs.size());
+  for(int64_t i = 0; i < (int64_t)contigs.size(); i++) record_colors[i] = i;
+  ColorAnnotation one_batch_colors(boss, contigs, record_colors, 2);
+  if(batched_colors.n_sets != one_batch_colors.n_sets || batched_colors.n_colors != (int64_t)contigs.size()
+     || batched_colors.color_name(1) != "contig1")
+    cout << "ERROR: the batched color construction built a different set table" << '\n';
+  for(int64_t v = 0; v < boss.node_count; v++){
+    ColorSet a = batched_colors.node_colors(v), b = one_batch_colors.node_colors(v);
+    if(batched_colors.set_id(v) != one_batch_colors.set_id(v) || !std::equal(a.begin(), a.end(), b.begin(), b.end()))
+      cout << "ERROR: the batched color construction gave node " << v << " different colors" << '\n';
+  }
+  std::remove(colors_filename.c_str());
+
+  // Check the counts of the stats against the node list in every layout
+  vector<KmerNode<uint64_t>> nodes = construct_node_list<uint64_t>(input, k);
+  int64_t expected_dummies = 0;
+  for(const KmerNode<uint64_t>& node : nodes) expected_dummies += node.length > 0 && node.length < k;
+  for(SelectFreeBOSS::Layout layout : {SelectFreeBOSS::SPLIT, SelectFreeBOSS::INTERLEAVED, SelectFreeBOSS::COMPRESSED}){
+    SelectFreeBOSS copy = boss;
+    copy.set_layout(layout);
+    IndexStats stats = index_stats(copy);
+    if(stats.n_dummies != expected_dummies || stats.n_kmers() != (int64_t)kmers.size() || stats.n_edges != copy.node_count - 1 || stats.total_bytes() <= 0)
+      cout << "ERROR: wrong stats in layout " << layout << '\n' << stats;
+  }
+  if(index_stats(minimal_dummies).n_dummies != k - 1)
+    cout << "ERROR: wrong number of dummies in the index without redundant dummies" << '\n';
 
-  // Add dollars
-  for(auto& keyval : kmers) {
-    if(keyval.second.second.size() == 0){
-      keyval.second.second.insert('$'); // Outgoing dollar
-      kmers.begin()->second.first.insert('$'); // Incoming dollar to root
+  // Check the navigation against the node list in every layout, with and without select
+  // support and the LCS array, and the predecessors against the forward steps of all nodes. A node has the
+  // out-edges of its whole suffix group.
+  vector<uint8_t> group_edges(nodes.size());
+  for(int64_t u = 0; u < (int64_t)nodes.size(); u++)
+    group_edges[u] = (nodes[u].edges & 0xF) | suffix_group_edges_before(nodes, u, k);
+  for(int64_t u = (int64_t)nodes.size() - 2; u >= 0; u--)
+    if(same_suffix_group(nodes[u], nodes[u+1], k)) group_edges[u] = group_edges[u+1];
+  for(int layout_case = 0; layout_case < 5; layout_case++){
+    SelectFreeBOSS copy = layout_case == 4 ? with_lcs : boss;
+    if(layout_case == 1) copy.build_select_support();
+    if(layout_case == 2) copy.set_layout(SelectFreeBOSS::INTERLEAVED);
+    if(layout_case == 3) copy.set_layout(SelectFreeBOSS::COMPRESSED);
+    vector<vector<int64_t>> expected_predecessors(copy.node_count);
+    for(int64_t u = 0; u < copy.node_count; u++){
+      string label = decode_label(nodes[u], k);
+      if(copy.label(u) != label || copy.outdegree(u) != __builtin_popcount(group_edges[u]))
+        cout << "ERROR: wrong label or outdegree of node " << u << " in layout case " << layout_case << '\n';
+      for(int c = 0; c < 4; c++){
+        int64_t v = copy.forward(u, "ACGT"[c]);
+        if(((group_edges[u] >> c) & 1) != (v >= 0) || (v >= 0 && decode_label(nodes[v], k) != (label + "ACGT"[c]).substr(1)))
+          cout << "ERROR: wrong forward step from node " << u << " with " << "ACGT"[c] << " in layout case " << layout_case << '\n';
+        if(v >= 0) expected_predecessors[v].push_back(u);
+      }
+    }
+    for(int64_t v = 0; v < copy.node_count; v++){
+      vector<int64_t> found;
+      copy.predecessors(v, found);
+      int64_t predecessor = copy.backward(v);
+      if(found != expected_predecessors[v] || (v == 0) != (predecessor == -1)
+         || (v > 0 && std::find(found.begin(), found.end(), predecessor) == found.end()))
+        cout << "ERROR: wrong predecessors of node " << v << " in layout case " << layout_case << '\n';
     }
   }
 
-  string SBWT[256];
-  SBWT['A'].resize(this->node_count, '0');
-  SBWT['C'].resize(this->node_count, '0');
-  SBWT['G'].resize(this->node_count, '0');
-  SBWT['T'].resize(this->node_count, '0');
-  string F_column;
-  int kmer_index = 0;
-  for(auto& keyval : kmers) {
-    cout << keyval.first << " " << keyval.second << '\n';
-    for(char c : keyval.second.second){
-      SBWT[c][kmer_index] = '1';
-      F_column += c;
+  // Check that merging the indexes of two halves of the contigs gives the index of all of
+  // them, for both k-mer integer types, and that merging an index with itself changes nothing.
+  // The merged index has the LCS array if either input has it.
+  for(int merge_k : {k, 40}){
+    vector<string> halves[2], all_pieces;
+    for(int64_t i = 0; i + 2 * merge_k <= (int64_t)input[0].size(); i += merge_k / 2 + 1){
+      halves[i % 2].push_back(input[0].substr(i, 2 * merge_k));
+      all_pieces.push_back(input[0].substr(i, 2 * merge_k));
     }
-    kmer_index++;
+    auto build = [&](const vector<string>& pieces, bool lcs){
+      if(merge_k <= 32) return SelectFreeBOSS::from_node_list(construct_node_list<uint64_t>(pieces, merge_k), merge_k, 1, false, lcs);
+      return SelectFreeBOSS::from_node_list(construct_node_list<__uint128_t>(pieces, merge_k), merge_k, 1, false, lcs);
+    };
+    SelectFreeBOSS half_A = build(halves[0], false), half_B = build(halves[1], true), whole = build(all_pieces, true);
+    half_B.set_layout(SelectFreeBOSS::INTERLEAVED);
+    SelectFreeBOSS merged = merge_boss(half_A, half_B, 2);
+    SelectFreeBOSS merged_twice = merge_boss(merged, merged, 2);
+    vector<string> merge_queries;
+    for(const string& piece : all_pieces)
+      for(int64_t i = 0; i + merge_k <= (int64_t)piece.size(); i++){
+        merge_queries.push_back(piece.substr(i, merge_k));
+        merge_queries.push_back(reverse_complement(piece.substr(i, merge_k)));
+      }
+    if(merged.node_count != whole.node_count || merged.C != whole.C || merged_twice.node_count != whole.node_count
+       || search_batch(merged, merge_queries) != search_batch(whole, merge_queries)
+       || search_batch(merged_twice, merge_queries) != search_batch(whole, merge_queries) || !merged.has_lcs())
+      cout << "ERROR: the merged index differs from the index of all pieces for k = " << merge_k << '\n';
+    for(int64_t v = 0; v < whole.node_count; v++)
+      if(merged.LCS[v] != whole.LCS[v] || merged.label(v) != whole.label(v) || merged.outdegree(v) != whole.outdegree(v))
+        cout << "ERROR: node " << v << " of the merged index differs for k = " << merge_k << '\n';
   }
 
-  this->SBWT['A'] = SBWT['A'];
-  this->SBWT['C'] = SBWT['C'];
-  this->SBWT['G'] = SBWT['G'];
-  this->SBWT['T'] = SBWT['T'];
-
-  // Add minus marks to SBWT
-  std::sort(F_column.begin(), F_column.end());
-  map<char,int> labels_seen;
-  int F_index = 0;
-  vector<int> counts(256);
-  for(char c : F_column) counts[c]++; // Will subtract minus-characters below
-  for(auto& keyval : kmers) {
-    int indegree = keyval.second.first.size();
-    char c = F_column[F_index];
-    if(c != '$'){ // Add minuses, but not for dollars
-      for(int i = 1; i < indegree; i++){ // All but the first in-edge
-        this->SBWT[c][select(SBWT[c], '1', labels_seen[c] + i + 1)] = '0'; // Turn off the bit
-        counts[c]--;
+  // Check that the unitigs hold every k-mer once, that none of them can be extended and that
+  // they do not depend on the number of threads. AACCGGTT read cyclically has distinct
+  // (k-1)-mers, so the sequence that wraps around into its start is a cycle without a branch.
+  for(const vector<string>& unitig_input : {input, contigs, {string("AACCGGTTAAC")}}){
+    SelectFreeBOSS graph = SelectFreeBOSS::from_node_list(construct_node_list<uint64_t>(unitig_input, k), k, 1, false);
+    SelectFreeBOSS graph_with_lcs = SelectFreeBOSS::from_node_list(construct_node_list<uint64_t>(unitig_input, k), k, 1, false, true);
+    vector<Unitig> unitigs = extract_unitigs(graph, 1);
+    vector<string> unitig_copy = unitig_input;
+    auto expected = extract_kmers(unitig_copy, k);
+    auto neighbours = [&](const string& kmer, bool successors){
+      vector<string> found;
+      for(char c : {'A', 'C', 'G', 'T'}){
+        string other = successors ? kmer.substr(1) + c : c + kmer.substr(0, k - 1);
+        if(expected.count(other)) found.push_back(other);
       }
+      return found;
+    };
+    std::map<string, int64_t> unitig_kmers;
+    for(const Unitig& unitig : unitigs){
+      for(int64_t i = 0; i + k <= (int64_t)unitig.sequence.size(); i++) unitig_kmers[unitig.sequence.substr(i, k)]++;
+      string first = unitig.sequence.substr(0, k), last = unitig.sequence.substr(unitig.sequence.size() - k);
+      vector<string> next = neighbours(last, true);
+      if(search(graph, first) != unitig.first_node || search(graph, last) != unitig.last_node
+         || (next.size() == 1 && next[0] != first && neighbours(next[0], false).size() == 1))
+        cout << "ERROR: unitig " << unitig.sequence << " has wrong end nodes or can be extended" << '\n';
     }
-    labels_seen[c] += indegree;
-    F_index += indegree;
+    bool all_once = unitig_kmers.size() == expected.size();
+    for(const auto& kmer : unitig_kmers) all_once = all_once && kmer.second == 1 && expected.count(kmer.first) > 0;
+    if(!all_once) cout << "ERROR: the unitigs do not hold every k-mer once" << '\n';
+    std::ostringstream one_thread, four_threads, gfa, lcs_fasta, lcs_gfa;
+    write_unitigs_fasta(one_thread, unitigs);
+    write_unitigs_fasta(four_threads, extract_unitigs(graph, 4));
+    write_unitigs_gfa(gfa, graph, unitigs);
+    write_unitigs_fasta(lcs_fasta, extract_unitigs(graph_with_lcs, 2));
+    write_unitigs_gfa(lcs_gfa, graph_with_lcs, extract_unitigs(graph_with_lcs, 2));
+    if(one_thread.str() != four_threads.str() || gfa.str().find("H\tVN:Z:1.0") != 0)
+      cout << "ERROR: the unitigs depend on the number of threads" << '\n';
+    if(lcs_fasta.str() != one_thread.str() || lcs_gfa.str() != gfa.str())
+      cout << "ERROR: the unitigs differ with the LCS array" << '\n';
+    if(unitig_input[0] == "AACCGGTTAAC" && (unitigs.size() != 1 || (int64_t)unitigs[0].sequence.size() != 8 + k - 1))
+      cout << "ERROR: the cycle is not one unitig" << '\n';
   }
 
-  this->C = construct_C(counts);
+#ifdef BOSS_COUNTERS
+  // A k-mer that is found takes one step and two rank queries per character
+  *boss_counters() = QueryCounters();
+  search(boss, queries[0]);
+  QueryCounters counters = *boss_counters();
+  if(counters.queries != 1 || counters.search_steps != k || counters.rank_calls != 2 * k || counters.early_terminations != 0)
+    cout << "ERROR: wrong query counters" << '\n';
+#endif
 
-  cout << "SBWT[\'A\'] = " << this->SBWT['A'] << '\n';
-  cout << "SBWT[\'C\'] = " << this->SBWT['C'] << '\n';
-  cout << "SBWT[\'G\'] = " << this->SBWT['G'] << '\n';
-  cout << "SBWT[\'T\'] = " << this->SBWT['T'] << '\n';
-  cout << this->C << '\n';
-}
-
-
-int search(SelectFreeBOSS& boss, const string& kmer){
-  int left = 0;
-  int right = boss.node_count - 1;
-  for(auto& c: kmer){
-    left = boss.C[c] + rank(boss.SBWT[c], '1', left);
-    right = boss.C[c] + rank(boss.SBWT[c], '1', right + 1) - 1;
-    if(left > right) return -1; // Not found
+  // Check the dynamic layer against a set of k-mers while updates, queries and
+  // background merges interleave, and after the last merge
+  std::mt19937_64 rng(1);
+  for(SelectFreeBOSS::Layout layout : {SelectFreeBOSS::SPLIT, SelectFreeBOSS::INTERLEAVED}){
+    SelectFreeBOSS base = boss;
+    base.set_layout(layout);
+    DynamicBOSS dynamic(base, 16, 2);
+    set<string> expected(kmers.begin(), kmers.end());
+    vector<string> universe = queries;
+    for(int round = 0; round < 400; round++){
+      string kmer = universe[rng() % universe.size()];
+      if(rng() % 4 == 0){
+        for(char& c : kmer) c = "ACGT"[rng() % 4];
+        universe.push_back(kmer);
+      }
+      if(rng() % 3 == 0){
+        dynamic.erase(kmer);
+        expected.erase(kmer);
+      } else {
+        dynamic.insert(kmer);
+        expected.insert(kmer);
+      }
+      string probe = universe[rng() % universe.size()];
+      if(dynamic.contains(probe) != (expected.count(probe) > 0))
+        cout << "ERROR: the dynamic index returned a wrong answer for k-mer " << probe << " in round " << round << '\n';
+    }
+    dynamic.wait();
+    dynamic.merge();
+    dynamic.wait();
+    std::shared_ptr<const SelectFreeBOSS> merged = dynamic.static_index();
+    if(dynamic.buffered() != 0 || merged->layout != layout)
+      cout << "ERROR: the last merge left " << dynamic.buffered() << " updates in the buffer" << '\n';
+    for(const string& kmer : universe)
+      if(dynamic.contains(kmer) != (expected.count(kmer) > 0) || (search(*merged, kmer) >= 0) != (expected.count(kmer) > 0))
+        cout << "ERROR: the merged index returned a wrong answer for k-mer " << kmer << '\n';
   }
-  assert(left == right);
-  return left;
-}
-
 
-set<string, decltype(colex_compare)*> extract_kmers(vector<string>& input, int k) {
-  set<string, decltype(colex_compare)*> kmers(colex_compare);
-  for(string& S : input)
-    for(int i = 0; i < S.size()-k+1; i++)
-      kmers.insert(S.substr(i,k));
-  return kmers;
-}
-
-int main(){
-  vector<string> input = {"GAAGCCGCCATTCCATAGTGAGTCCTTCGTCTGTGACTATCTGTGCCAGATCGTCTAGCAAACTGCTGATCCAGTTTATCTCACCAAATTATAGCCGTACAGACCGAAATCTTAAGTCATATCACGCGACTAGGCTCAGCTTTATTTTTGTGGTCATGGGTTTTGGTCCGCCCGAGCGGTGCAGCCGATTAGGACCATGT"};
-  int k = 4;
-  SelectFreeBOSS boss(input, k);
-  auto kmers = extract_kmers(input, k);
+  // Check that an index written to disk and mapped back gives the same answers
+  boss.save(filename);
+  SelectFreeBOSS loaded = SelectFreeBOSS::load(filename);
   for(string kmer : kmers)
-    cout << search(boss, kmer) << '\n';
+    if(search(loaded, kmer) != search(boss, kmer))
+      cout << "ERROR: loaded index returned a different answer for k-mer " << kmer << '\n';
+  std::remove(filename.c_str());
 }
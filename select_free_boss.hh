@@ -0,0 +1,684 @@
+#pragma once
+
+#include <iostream>
+#include <set>
+#include <vector>
+#include <map>
+#include <string>
+#include <cassert>
+#include <algorithm>
+#include "stdlib_printing.hh"
+#include "bit_vector.hh"
+#include "interleaved_sbwt.hh"
+#include "kmer_nodes.hh"
+#include "parallel.hh"
+#include "sequence_reader.hh"
+#include "index_stats.hh"
+#include "query_counters.h"
+
+using std::string;
+using std::vector;
+using std::map;
+using std::set;
+using std::cout;
+
+class SelectFreeBOSS{
+public:
+  // k <= 64. With minimal_dummies, only the dummy nodes that some k-mer needs are added
+  // (see remove_redundant_dummies), and removed_dummies tells how many were left out.
+  // With both_strands, the reverse complements of the sequences are indexed as well.
+  // With with_lcs, the LCS array is built as well (see LCS).
+  SelectFreeBOSS(const vector<string>& input, int k, int n_threads = 1, bool minimal_dummies = false, bool both_strands = false,
+                 bool with_lcs = false);
+  // Reads the input in batches of about batch_bases characters. Sequences are split at non-ACGT characters.
+  SelectFreeBOSS(SequenceReader& input, int k, int n_threads = 1, int64_t batch_bases = 1 << 28, bool minimal_dummies = false,
+                 bool both_strands = false, bool with_lcs = false);
+  // Layout of the SBWT bit vectors: one bit vector per character in SBWT, all four
+  // interleaved in `interleaved` so that one cache line answers rank for every character,
+  // or one RRR compressed bit vector per character in SBWT (smaller, slower rank). The
+  // compressed layout drops the LCS array, which would be larger than the bit vectors.
+  enum Layout { SPLIT = 0, INTERLEAVED = 1, COMPRESSED = 2 };
+  Layout layout = SPLIT;
+  // One bit vector for each character. Can be empty bit vector if the character does not occur
+  BitVector SBWT[256];
+  // SBWT['A'], SBWT['C'], SBWT['G'], SBWT['T'] are all bit vectors in the SPLIT and COMPRESSED layouts
+  InterleavedSBWT interleaved;
+  vector<int64_t> C; // C-array (cumulative character counts)
+  // Optional. LCS[i] = length of the longest common suffix of the labels of nodes i-1 and i,
+  // packed in ceil(log2(k+1)) bits per node. Streaming search and matching statistics use it
+  // to drop the first character of a match in a few steps, and the suffix groups come from it
+  // directly. Without it, both compare labels with backward steps instead.
+  IntVector LCS;
+  int64_t node_count;
+  int64_t k;
+  int64_t removed_dummies = 0; // Redundant dummy nodes left out by the construction. Not stored in index files.
+  bool both_strands = false; // Every k-mer is indexed together with its reverse complement
+  // Optional table of the SBWT intervals of all strings of length prefix_length. The interval
+  // of the string with 2-bit codes x_1...x_p (x_1 most significant) is [prefix_table[2x], prefix_table[2x+1]].
+  int prefix_length = 0;
+  Array<int64_t> prefix_table;
+
+  // Builds the prefix table for strings of length p (at most min(k, 14), 4^p intervals).
+  // p = 0 removes the table.
+  void build_prefix_table(int p, int n_threads = 1);
+  // Sets [left, right] to the interval of S[begin..begin+prefix_length) from the table and
+  // returns prefix_length. If the table is not available for S[begin..end), sets the full
+  // interval and returns 0.
+  int64_t lookup_prefix(const string& S, int64_t begin, int64_t end, int64_t& left, int64_t& right) const;
+
+  // Number of ones in [0..position) in the bit vector of c, which must be one of A, C, G, T
+  int64_t rank(char c, int64_t position) const;
+  // Brings the memory that rank(c, position) reads into the cache ahead of time
+  void prefetch(char c, int64_t position) const;
+  // Bits 0..3: the node has an unmarked out-edge with A, C, G, T
+  uint8_t out_edges(int64_t node) const;
+  // Rearranges the SBWT bit vectors into the layout
+  void set_layout(Layout layout);
+  bool has_lcs() const { return LCS.size() > 0; }
+
+  // Navigation of the graph by colex rank. The nodes that agree on their last k-1
+  // characters (a suffix group, at most five nodes) share their out-edges:
+  // every node of the group has the edges of all of them. Each edge is stored at the first
+  // node of the group that has it, so forward steps take a few rank queries. A backward
+  // step takes one select query.
+  int outdegree(int64_t node) const;
+  // The node reached from `node` with character c, or -1 if there is no such edge
+  int64_t forward(int64_t node, char c) const;
+  // Last character of the label of the node, or '$' for the root
+  char incoming_character(int64_t node) const;
+  // The predecessor of the node that stores the unmarked edge to it, or -1 for the root.
+  // The other predecessors are the rest of its suffix group.
+  int64_t backward(int64_t node) const;
+  // Appends the predecessors of the node in colex order, including dummies
+  void predecessors(int64_t node, vector<int64_t>& out) const;
+  // The label of the node, padded with dollars at the start for the root and the dummies.
+  // Takes up to k backward steps.
+  string label(int64_t node) const;
+  // The range [first, last] of the suffix group of the node. Without the LCS array, takes
+  // up to k-1 backward steps per neighbour.
+  void suffix_group(int64_t node, int64_t& first, int64_t& last) const;
+  // Whether nodes i-1 and i are in the same suffix group
+  bool same_suffix_group_as_previous(int64_t i) const;
+  // Adds select support to the SBWT bit vectors of the split layout, which backward uses;
+  // index files store it. The compressed layout always has select support. Without it,
+  // backward binary searches with rank queries instead.
+  void build_select_support();
+
+  // Writes the structure to a binary index file
+  void save(const string& filename) const;
+  // Maps an index file into memory and queries it in place
+  static SelectFreeBOSS load(const string& filename);
+  // Builds the structure from a colex-sorted node list that starts with the root, such as
+  // the one from node_list_from_kmers. Without `verbose`, the debug dump is not printed. It is
+  // printed by default while construction_dump is set.
+  template <typename kmer_t>
+  static SelectFreeBOSS from_node_list(const vector<KmerNode<kmer_t>>& nodes, int k, int n_threads = 1, bool verbose = construction_dump,
+                                       bool with_lcs = false);
+
+private:
+  SelectFreeBOSS() {}
+  template <typename kmer_t> void construct_from_input(vector<KmerNode<kmer_t>>&& nodes, int k, int n_threads, bool minimal_dummies, bool with_lcs);
+  template <typename kmer_t> void construct(const vector<KmerNode<kmer_t>>& nodes, int k, int n_threads, bool verbose, bool with_lcs);
+  std::shared_ptr<const void> mapping; // Keeps a loaded index file mapped
+  // Position of the count-th (1-based) one in the bit vector of c
+  int64_t select(char c, int64_t count) const;
+};
+
+// true if S is colexicographically-smaller than T
+inline bool colex_compare(const string& S, const string& T) {
+  for (int i_s = S.size() - 1, i_t = T.size() - 1;; --i_s, --i_t){
+    // One of the strings is a suffix of the other. Return the shorter.
+    if(i_s < 0 || i_t < 0) return S.size() < T.size();
+    if(S[i_s] != T[i_t]) return S[i_s] < T[i_t];
+  }
+}
+
+inline vector<int64_t> cumulative_sum_of_counts(const vector<int64_t>& counts) {
+  vector<int64_t> C(counts);
+  for (int i = 1; i < (int64_t)C.size(); ++i)
+    C[i] += C[i-1];
+  return C;
+}
+
+template <typename T>
+inline void shift_vector_to_the_right_by_1(vector<T>& v){
+  for(int64_t i = v.size() - 1; i > 0; --i)
+    v[i] = v[i-1];
+  v[0] = 0;
+}
+
+inline vector<int64_t> construct_C(const vector<int64_t>& counts){
+  vector<int64_t> C = cumulative_sum_of_counts(counts);
+  shift_vector_to_the_right_by_1(C); // we shift to follow the definition
+  return C;
+}
+
+// Edge-centric definition.
+// k is the length of node labels.
+inline SelectFreeBOSS::SelectFreeBOSS(const vector<string>& input, int k, int n_threads, bool minimal_dummies, bool both_strands,
+                                      bool with_lcs)
+  : both_strands(both_strands) {
+  n_threads = std::max(n_threads, 1);
+  if(k <= 32) construct_from_input(construct_node_list<uint64_t>(input, k, n_threads, both_strands), k, n_threads, minimal_dummies, with_lcs);
+  else construct_from_input(construct_node_list<__uint128_t>(input, k, n_threads, both_strands), k, n_threads, minimal_dummies, with_lcs);
+}
+
+inline SelectFreeBOSS::SelectFreeBOSS(SequenceReader& input, int k, int n_threads, int64_t batch_bases, bool minimal_dummies, bool both_strands,
+                                      bool with_lcs)
+  : both_strands(both_strands) {
+  n_threads = std::max(n_threads, 1);
+  auto next_batch = [&](vector<string>& batch){ return input.read_batch(batch, batch_bases, k); };
+  if(k <= 32) construct_from_input(construct_node_list_from_batches<uint64_t>(next_batch, k, n_threads, both_strands), k, n_threads, minimal_dummies, with_lcs);
+  else construct_from_input(construct_node_list_from_batches<__uint128_t>(next_batch, k, n_threads, both_strands), k, n_threads, minimal_dummies, with_lcs);
+}
+
+// Builds the structure from the node list of the input, which has every dummy
+template <typename kmer_t>
+void SelectFreeBOSS::construct_from_input(vector<KmerNode<kmer_t>>&& nodes, int k, int n_threads, bool minimal_dummies, bool with_lcs){
+  if(minimal_dummies) this->removed_dummies = remove_redundant_dummies(nodes, k, n_threads);
+  add_missing_root(nodes);
+  construct(nodes, k, n_threads, construction_dump, with_lcs);
+}
+
+// Builds the structure from the colex-sorted node list
+template <typename kmer_t>
+void SelectFreeBOSS::construct(const vector<KmerNode<kmer_t>>& nodes, int k, int n_threads, bool verbose, bool with_lcs){
+  if(nodes.empty() || nodes[0].length != 0) throw std::invalid_argument("The node list has no root");
+
+  this->node_count = nodes.size();
+  this->k = k;
+
+  for(int64_t i = 0; i < this->node_count && verbose; i++)
+    cout << decode_label(nodes[i], k) << " " << std::make_pair(edge_set(nodes[i].edges >> 4), edge_set(nodes[i].edges & 0xF)) << '\n';
+
+  // Minus marks are already removed from the out-edge masks
+  vector<uint8_t> out_edges = unmarked_out_edges(nodes, k, n_threads);
+
+  // Fill the bit vectors in ranges of whole words so that threads never write to the same word.
+  // Each range also counts the nodes whose label ends in each character, for the C array.
+  for(char c : {'A', 'C', 'G', 'T'}) this->SBWT[(unsigned char)c] = BitVector(this->node_count);
+  int lcs_width = 1;
+  while((1 << lcs_width) <= k) lcs_width++;
+  if(with_lcs) this->LCS = IntVector(this->node_count, lcs_width);
+  vector<int64_t> ranges = split_range(this->node_count, n_threads, 64);
+  vector<vector<int64_t>> range_counts(n_threads, vector<int64_t>(256));
+  parallel_for(n_threads, n_threads, [&](int64_t t){
+    for(int64_t i = ranges[t]; i < ranges[t+1]; i++){
+      for(int c = 0; c < 4; c++)
+        if(out_edges[i] & (1 << c)) this->SBWT[(unsigned char)"ACGT"[c]].set(i, 1);
+      range_counts[t][last_character(nodes[i], k)]++;
+      if(with_lcs && i > 0) this->LCS.set(i, longest_common_suffix(nodes[i-1], nodes[i], k));
+    }
+  });
+
+  vector<int64_t> counts(256);
+  for(const vector<int64_t>& range_count : range_counts)
+    for(int c = 0; c < 256; c++) counts[c] += range_count[c];
+  this->C = construct_C(counts);
+
+  for(char c : {'A', 'C', 'G', 'T'})
+    this->SBWT[(unsigned char)c].init_rank_support();
+
+  if(!verbose) return;
+  cout << "SBWT[\'A\'] = " << this->SBWT['A'] << '\n';
+  cout << "SBWT[\'C\'] = " << this->SBWT['C'] << '\n';
+  cout << "SBWT[\'G\'] = " << this->SBWT['G'] << '\n';
+  cout << "SBWT[\'T\'] = " << this->SBWT['T'] << '\n';
+  cout << this->C << '\n';
+}
+
+template <typename kmer_t>
+SelectFreeBOSS SelectFreeBOSS::from_node_list(const vector<KmerNode<kmer_t>>& nodes, int k, int n_threads, bool verbose, bool with_lcs){
+  SelectFreeBOSS boss;
+  boss.construct(nodes, k, std::max(n_threads, 1), verbose, with_lcs);
+  return boss;
+}
+
+inline void SelectFreeBOSS::save(const string& filename) const {
+  IndexWriter out(filename, INDEX_SELECT_FREE_BOSS);
+  out.write_scalar(k);
+  out.write_scalar(node_count);
+  out.write_array(C);
+  out.write_scalar(layout);
+  if(layout != INTERLEAVED) for(char c : {'A', 'C', 'G', 'T'}) SBWT[(unsigned char)c].serialize(out);
+  else interleaved.serialize(out);
+  out.write_scalar(has_lcs());
+  if(has_lcs()) LCS.serialize(out);
+  out.write_scalar(prefix_length);
+  out.write_array(prefix_table);
+  out.write_scalar(both_strands);
+  out.close();
+}
+
+inline SelectFreeBOSS SelectFreeBOSS::load(const string& filename){
+  IndexReader in(filename, INDEX_SELECT_FREE_BOSS);
+  SelectFreeBOSS boss;
+  boss.k = in.read_scalar();
+  boss.node_count = in.read_scalar();
+  boss.C = in.read_vector<int64_t>();
+  boss.layout = (Layout)in.read_scalar();
+  if(boss.layout == SPLIT || boss.layout == COMPRESSED) for(char c : {'A', 'C', 'G', 'T'}) boss.SBWT[(unsigned char)c] = BitVector::load(in);
+  else if(boss.layout == INTERLEAVED) boss.interleaved = InterleavedSBWT::load(in);
+  else throw std::runtime_error(filename + ": unknown SBWT layout");
+  if(in.read_scalar()) boss.LCS = IntVector::load(in);
+  boss.prefix_length = in.read_scalar();
+  boss.prefix_table = in.read_array<int64_t>();
+  boss.both_strands = in.read_scalar();
+  boss.mapping = in.mapping();
+  return boss;
+}
+
+// Searches the prefixes level by level. Each interval is one step from the interval
+// of its prefix one character shorter.
+inline void SelectFreeBOSS::build_prefix_table(int p, int n_threads){
+  if(p < 0 || p > std::min<int64_t>(k, 14))
+    throw std::invalid_argument("Prefix length " + std::to_string(p) + " is not between 0 and min(k, 14)");
+  prefix_length = p;
+  prefix_table = Array<int64_t>();
+  if(p == 0) return;
+
+  vector<int64_t> level = {0, node_count - 1};
+  for(int length = 1; length <= p; length++){
+    int64_t n_parents = level.size() / 2;
+    vector<int64_t> next(8 * n_parents);
+    vector<int64_t> ranges = split_range(n_parents, n_threads);
+    parallel_for(n_threads, n_threads, [&](int64_t t){
+      for(int64_t x = ranges[t]; x < ranges[t+1]; x++){
+        for(int code = 0; code < 4; code++){
+          char c = "ACGT"[code];
+          int64_t left = 0, right = -1; // Empty
+          if(level[2*x] <= level[2*x+1]){
+            left = C[c] + rank(c, level[2*x]);
+            right = C[c] + rank(c, level[2*x+1] + 1) - 1;
+            if(left > right) left = 0, right = -1;
+          }
+          next[8*x + 2*code] = left;
+          next[8*x + 2*code + 1] = right;
+        }
+      }
+    });
+    level.swap(next);
+  }
+  prefix_table = Array<int64_t>(level.size());
+  std::copy(level.begin(), level.end(), &prefix_table[0]);
+}
+
+inline int64_t SelectFreeBOSS::rank(char c, int64_t position) const {
+  if(layout != INTERLEAVED) return SBWT[(unsigned char)c].rank1(position);
+  return interleaved.rank(nucleotide_code(c), position);
+}
+
+inline void SelectFreeBOSS::prefetch(char c, int64_t position) const {
+  if(layout != INTERLEAVED) SBWT[(unsigned char)c].prefetch(position);
+  else interleaved.prefetch(position);
+}
+
+inline uint8_t SelectFreeBOSS::out_edges(int64_t node) const {
+  if(layout == INTERLEAVED) return interleaved[node];
+  uint8_t mask = 0;
+  for(int c = 0; c < 4; c++) mask |= SBWT[(unsigned char)"ACGT"[c]][node] << c;
+  return mask;
+}
+
+inline bool SelectFreeBOSS::same_suffix_group_as_previous(int64_t i) const {
+  if(has_lcs()) return LCS[i] >= k - 1;
+  // The last k-1 characters, one backward step at a time. The root has only dollars.
+  for(int64_t j = 0, u = i - 1, v = i; j < k - 1; j++, u = backward(u), v = backward(v)){
+    char c = incoming_character(u);
+    if(c == '$' || c != incoming_character(v)) return false;
+  }
+  return true;
+}
+
+inline void SelectFreeBOSS::suffix_group(int64_t node, int64_t& first, int64_t& last) const {
+  first = last = node;
+  while(first > 0 && same_suffix_group_as_previous(first)) first--;
+  while(last + 1 < node_count && same_suffix_group_as_previous(last + 1)) last++;
+}
+
+inline int SelectFreeBOSS::outdegree(int64_t node) const {
+  int64_t first, last;
+  suffix_group(node, first, last);
+  uint8_t mask = 0;
+  for(int64_t i = first; i <= last; i++) mask |= out_edges(i);
+  return __builtin_popcount(mask);
+}
+
+inline int64_t SelectFreeBOSS::forward(int64_t node, char c) const {
+  int code = nucleotide_code(c);
+  if(code < 0) return -1;
+  int64_t first, last;
+  suffix_group(node, first, last);
+  for(int64_t i = first; i <= last; i++)
+    if((out_edges(i) >> code) & 1) return C[c] + rank(c, i);
+  return -1;
+}
+
+// The nodes that end in c are [C[c], C[next character]). C of a character that no label
+// ends in equals C of the next one, so searching from T down finds the right range.
+inline char SelectFreeBOSS::incoming_character(int64_t node) const {
+  for(char c : {'T', 'G', 'C', 'A'})
+    if(node >= C[c]) return c;
+  return '$';
+}
+
+// The edges with character c reach the nodes that end in c in node order, so the node
+// C[c] + i is reached by the (i+1)-th edge with c
+inline int64_t SelectFreeBOSS::backward(int64_t node) const {
+  char c = incoming_character(node);
+  if(c == '$') return -1;
+  return select(c, node - C[c] + 1);
+}
+
+inline void SelectFreeBOSS::predecessors(int64_t node, vector<int64_t>& out) const {
+  int64_t predecessor = backward(node);
+  if(predecessor < 0) return;
+  int64_t first, last;
+  suffix_group(predecessor, first, last);
+  for(int64_t i = first; i <= last; i++) out.push_back(i);
+}
+
+inline string SelectFreeBOSS::label(int64_t node) const {
+  string S(k, '$');
+  for(int64_t i = k - 1; i >= 0 && node > 0; i--){
+    S[i] = incoming_character(node);
+    node = backward(node);
+  }
+  return S;
+}
+
+inline void SelectFreeBOSS::build_select_support(){
+  if(layout != SPLIT) return;
+  for(char c : {'A', 'C', 'G', 'T'}) SBWT[(unsigned char)c].init_select_support();
+}
+
+inline int64_t SelectFreeBOSS::select(char c, int64_t count) const {
+  const BitVector& B = SBWT[(unsigned char)c];
+  if(layout == COMPRESSED || (layout == SPLIT && B.select_samples.size() > 0)) return B.select1(count);
+  int64_t lo = 0, hi = node_count - 1; // First position with count ones up to it
+  while(lo < hi){
+    int64_t mid = lo + (hi - lo) / 2;
+    if(rank(c, mid + 1) >= count) hi = mid;
+    else lo = mid + 1;
+  }
+  return lo;
+}
+
+inline void SelectFreeBOSS::set_layout(Layout new_layout){
+  if(new_layout == layout) return;
+  vector<uint8_t> masks(node_count);
+  for(int64_t i = 0; i < node_count; i++) masks[i] = out_edges(i);
+  if(new_layout == INTERLEAVED){
+    interleaved = InterleavedSBWT(masks);
+    for(char c : {'A', 'C', 'G', 'T'}) SBWT[(unsigned char)c] = BitVector();
+  } else {
+    for(int c = 0; c < 4; c++){
+      BitVector& B = SBWT[(unsigned char)"ACGT"[c]];
+      B = BitVector(node_count);
+      for(int64_t i = 0; i < node_count; i++) B.set(i, (masks[i] >> c) & 1);
+      B.init_rank_support();
+      if(new_layout == COMPRESSED) B.compress();
+    }
+    interleaved = InterleavedSBWT();
+  }
+  if(new_layout == COMPRESSED) LCS = IntVector();
+  layout = new_layout;
+}
+
+inline int64_t SelectFreeBOSS::lookup_prefix(const string& S, int64_t begin, int64_t end, int64_t& left, int64_t& right) const {
+  left = 0;
+  right = node_count - 1;
+  if(prefix_length == 0 || end - begin < prefix_length) return 0;
+  int64_t x = 0;
+  for(int64_t i = begin; i < begin + prefix_length; i++){
+    int code = nucleotide_code(S[i]);
+    if(code < 0) return 0; // Not in the alphabet. The search reports it.
+    x = 4 * x + code;
+  }
+  left = prefix_table[2*x];
+  right = prefix_table[2*x+1];
+  return prefix_length;
+}
+
+inline int64_t search(const SelectFreeBOSS& boss, const string& kmer){
+  BOSS_COUNT(queries);
+  int64_t left, right;
+  int64_t start = boss.lookup_prefix(kmer, 0, kmer.size(), left, right);
+  if(left > right){ // Not found
+    BOSS_COUNT(early_terminations);
+    return -1;
+  }
+  for(int64_t i = start; i < (int64_t)kmer.size(); i++){
+    char c = kmer[i];
+    if(nucleotide_code(c) < 0){ // Not in the alphabet
+      BOSS_COUNT(early_terminations);
+      return -1;
+    }
+    left = boss.C[c] + boss.rank(c, left);
+    right = boss.C[c] + boss.rank(c, right + 1) - 1;
+    BOSS_COUNT(search_steps);
+    if(left > right){ // Not found
+      if(i + 1 < (int64_t)kmer.size()) BOSS_COUNT(early_terminations);
+      return -1;
+    }
+  }
+  assert(left == right);
+  return left;
+}
+
+// Searches many k-mers. Groups of batch_size searches advance in lockstep, one
+// character per round. After a search takes its step, the rank blocks of its next
+// step are prefetched, so the cache misses of the whole group overlap instead of
+// each search waiting for its own. Searches that start from the prefix table skip
+// the rounds of the characters it covers.
+inline vector<int64_t> search_batch(const SelectFreeBOSS& boss, const vector<string>& kmers, int batch_size = 32){
+  vector<int64_t> results(kmers.size());
+  vector<int64_t> left(batch_size), right(batch_size), first(batch_size);
+  for(int64_t start = 0; start < (int64_t)kmers.size(); start += batch_size){
+    int64_t end = std::min<int64_t>(start + batch_size, kmers.size());
+    int64_t max_length = 0;
+    for(int64_t j = start; j < end; j++){
+      const string& kmer = kmers[j];
+      int64_t& l = left[j-start];
+      int64_t& r = right[j-start];
+      first[j-start] = boss.lookup_prefix(kmer, 0, kmer.size(), l, r);
+      BOSS_COUNT(queries);
+      if(l > r) BOSS_COUNT(early_terminations);
+      int64_t i = first[j-start];
+      if(l <= r && i < (int64_t)kmer.size() && nucleotide_code(kmer[i]) >= 0){
+        boss.prefetch(kmer[i], l);
+        boss.prefetch(kmer[i], r + 1);
+      }
+      max_length = std::max<int64_t>(max_length, kmer.size());
+    }
+    for(int64_t i = 0; i < max_length; i++){
+      for(int64_t j = start; j < end; j++){
+        int64_t& l = left[j-start];
+        int64_t& r = right[j-start];
+        if(l > r || i >= (int64_t)kmers[j].size()) continue; // Finished
+        if(i < first[j-start]) continue; // Covered by the prefix table
+        char c = kmers[j][i];
+        if(nucleotide_code(c) < 0){ // Not in the alphabet
+          l = 1; r = 0;
+          BOSS_COUNT(early_terminations);
+          continue;
+        }
+        l = boss.C[c] + boss.rank(c, l);
+        r = boss.C[c] + boss.rank(c, r + 1) - 1;
+        BOSS_COUNT(search_steps);
+        if(l > r && i + 1 < (int64_t)kmers[j].size()) BOSS_COUNT(early_terminations);
+        if(l <= r && i + 1 < (int64_t)kmers[j].size() && nucleotide_code(kmers[j][i+1]) >= 0){
+          boss.prefetch(kmers[j][i+1], l);
+          boss.prefetch(kmers[j][i+1], r + 1);
+        }
+      }
+    }
+    for(int64_t j = start; j < end; j++)
+      results[j] = left[j-start] > right[j-start] ? -1 : left[j-start];
+  }
+  return results;
+}
+
+// Calls f(i, d, left, right) for every position i of the read, where read(i-d..i] is the
+// longest suffix of read[0..i] that is a suffix of a node label, up to k characters, and
+// [left, right] is its interval of nodes. The search extends the match by one character
+// per step. Dropping the first character of the match widens the interval to the
+// neighbours whose longest common suffix with it is still long enough, found by scanning
+// the LCS array. If the scan gets long, or the index has no LCS array, the shorter match is
+// searched from scratch instead.
+template <typename Function>
+void streaming_match(const SelectFreeBOSS& boss, const string& read, const Function& f){
+  const int64_t max_scan = 64;
+  int64_t k = boss.k, n = boss.node_count;
+  int64_t left = 0, right = n - 1;
+  int64_t d = 0; // Length of the match read[i-d..i)
+
+  // Drops the first character of the match read[i-d..i)
+  auto shrink = [&](int64_t i){
+    d--;
+    int64_t steps = boss.has_lcs() ? 0 : max_scan;
+    while(steps < max_scan && left > 0 && boss.LCS[left] >= d){ left--; steps++; }
+    while(steps < max_scan && right + 1 < n && boss.LCS[right + 1] >= d){ right++; steps++; }
+    if(steps == max_scan){
+      for(int64_t j = i - d + boss.lookup_prefix(read, i - d, i, left, right); j < i; j++){
+        char c = read[j];
+        left = boss.C[c] + boss.rank(c, left);
+        right = boss.C[c] + boss.rank(c, right + 1) - 1;
+        BOSS_COUNT(search_steps);
+      }
+    }
+  };
+
+  BOSS_COUNT(queries);
+  for(int64_t i = 0; i < (int64_t)read.size(); i++){
+    char c = read[i];
+    if(nucleotide_code(c) < 0){ // Not in the alphabet: no k-mer can contain this position
+      d = 0, left = 0, right = n - 1;
+    } else {
+      if(d == k) shrink(i);
+      while(true){
+        int64_t new_left = boss.C[c] + boss.rank(c, left);
+        int64_t new_right = boss.C[c] + boss.rank(c, right + 1) - 1;
+        BOSS_COUNT(search_steps);
+        if(new_left <= new_right){
+          left = new_left, right = new_right;
+          d++;
+          break;
+        }
+        if(d == 0) break; // No label ends with c
+        shrink(i);
+      }
+    }
+    f(i, d, left, right);
+  }
+}
+
+// Colex ranks of all k-mers of the read in order of their starting positions, or -1
+// for k-mers that are not found
+inline vector<int64_t> streaming_search(const SelectFreeBOSS& boss, const string& read){
+  vector<int64_t> results;
+  int64_t k = boss.k;
+  streaming_match(boss, read, [&](int64_t i, int64_t d, int64_t left, int64_t){
+    if(i >= k - 1) results.push_back(d == k ? left : -1);
+  });
+  return results;
+}
+
+// Matching statistics of the read: for every position i, the length of the longest suffix
+// of read[0..i] that occurs in the graph, up to k. Every substring of a k-mer is a suffix
+// of the label of a k-mer or of a dummy, so this is the length of the match of streaming_match.
+inline vector<int> matching_statistics(const SelectFreeBOSS& boss, const string& read){
+  vector<int> lengths(read.size());
+  streaming_match(boss, read, [&](int64_t i, int64_t d, int64_t, int64_t){ lengths[i] = d; });
+  return lengths;
+}
+
+// streaming_search and matching_statistics together, from one pass over the read
+inline void streaming_search(const SelectFreeBOSS& boss, const string& read, vector<int64_t>& ranks, vector<int>& lengths){
+  int64_t k = boss.k;
+  ranks.clear();
+  lengths.resize(read.size());
+  streaming_match(boss, read, [&](int64_t i, int64_t d, int64_t left, int64_t){
+    lengths[i] = d;
+    if(i >= k - 1) ranks.push_back(d == k ? left : -1);
+  });
+}
+
+// Colex ranks of the k-mer and of its reverse complement, or -1 for either that is not
+// found. The two searches are independent, so they advance in lockstep, one character
+// per round, and the cache misses of one overlap with those of the other.
+inline std::pair<int64_t, int64_t> search_both_strands(const SelectFreeBOSS& boss, const string& kmer){
+  string rc = reverse_complement(kmer);
+  const string* strands[2] = {&kmer, &rc};
+  int64_t left[2], right[2], first[2];
+  for(int s = 0; s < 2; s++){
+    first[s] = boss.lookup_prefix(*strands[s], 0, kmer.size(), left[s], right[s]);
+    BOSS_COUNT(queries);
+    if(left[s] > right[s]) BOSS_COUNT(early_terminations);
+  }
+  for(int64_t i = std::min(first[0], first[1]); i < (int64_t)kmer.size(); i++){
+    for(int s = 0; s < 2; s++){
+      if(left[s] > right[s] || i < first[s]) continue; // Not found, or covered by the prefix table
+      char c = (*strands[s])[i];
+      if(nucleotide_code(c) < 0){ // Not in the alphabet
+        left[s] = 1; right[s] = 0;
+        BOSS_COUNT(early_terminations);
+        continue;
+      }
+      left[s] = boss.C[c] + boss.rank(c, left[s]);
+      right[s] = boss.C[c] + boss.rank(c, right[s] + 1) - 1;
+      BOSS_COUNT(search_steps);
+      if(left[s] > right[s] && i + 1 < (int64_t)kmer.size()) BOSS_COUNT(early_terminations);
+    }
+  }
+  return {left[0] > right[0] ? -1 : left[0], left[1] > right[1] ? -1 : left[1]};
+}
+
+// search_both_strands for many k-mers. Each k-mer and its reverse complement are searched
+// in the same batch.
+inline vector<std::pair<int64_t, int64_t>> search_batch_both_strands(const SelectFreeBOSS& boss, const vector<string>& kmers, int batch_size = 32){
+  vector<string> queries;
+  queries.reserve(2 * kmers.size());
+  for(const string& kmer : kmers){
+    queries.push_back(kmer);
+    queries.push_back(reverse_complement(kmer));
+  }
+  vector<int64_t> results = search_batch(boss, queries, 2 * ((batch_size + 1) / 2));
+  vector<std::pair<int64_t, int64_t>> pairs(kmers.size());
+  for(int64_t i = 0; i < (int64_t)kmers.size(); i++) pairs[i] = {results[2*i], results[2*i+1]};
+  return pairs;
+}
+
+// streaming_search on both strands: for every k-mer of the read, in order of the starting
+// positions, the colex ranks of the k-mer and of its reverse complement. The reverse
+// complements are the k-mers of the reverse complement of the read in the opposite order.
+inline vector<std::pair<int64_t, int64_t>> streaming_search_both_strands(const SelectFreeBOSS& boss, const string& read){
+  vector<int64_t> forward = streaming_search(boss, read);
+  vector<int64_t> reverse = streaming_search(boss, reverse_complement(read));
+  vector<std::pair<int64_t, int64_t>> results(forward.size());
+  for(int64_t i = 0; i < (int64_t)forward.size(); i++) results[i] = {forward[i], reverse[forward.size() - 1 - i]};
+  return results;
+}
+
+// Sizes of the components of the structure and its node counts. Counting the dummies
+// walks them from the root, which takes a few rank queries per dummy.
+inline IndexStats index_stats(const SelectFreeBOSS& boss){
+  IndexStats stats;
+  stats.structure = "SelectFreeBOSS";
+  stats.k = boss.k;
+  stats.n_nodes = boss.node_count;
+  for(char c : {'A', 'C', 'G', 'T'}){
+    stats.n_edges += boss.rank(c, boss.node_count);
+    if(boss.layout != SelectFreeBOSS::INTERLEAVED) stats.add(string("SBWT[") + c + "]", boss.SBWT[(unsigned char)c]);
+  }
+  if(boss.layout == SelectFreeBOSS::INTERLEAVED) stats.add("SBWT interleaved lines", sizeof(InterleavedSBWT::Line) * boss.interleaved.lines.size());
+  stats.add("C array", sizeof(int64_t) * boss.C.size());
+  stats.add("LCS array", boss.LCS.size_in_bytes());
+  stats.add("prefix table", sizeof(int64_t) * boss.prefix_table.size());
+  stats.n_dummies = count_dummies(boss.node_count, boss.k, [&](int64_t u, vector<int64_t>& out){
+    uint8_t mask = boss.out_edges(u);
+    for(int c = 0; c < 4; c++)
+      if((mask >> c) & 1) out.push_back(boss.C["ACGT"[c]] + boss.rank("ACGT"[c], u));
+  });
+  return stats;
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cstring>
+#include <cctype>
+#include <cstdio>
+#include <zlib.h>
+
+using std::string;
+using std::vector;
+
+// Streaming reader for FASTA and FASTQ files, optionally gzipped. The format is
+// detected from the first character of the file. FASTQ records must have the
+// sequence on a single line.
+class SequenceReader{
+public:
+  SequenceReader(const string& filename) : filename(filename), buffer(1 << 16) {
+    file = gzopen(filename.c_str(), "rb");
+    if(file == nullptr) throw std::runtime_error("Could not open " + filename);
+    int c = peek();
+    if(c == '>') fastq = false;
+    else if(c == '@') fastq = true;
+    else if(c != EOF) throw std::runtime_error("Unknown file format: " + filename);
+  }
+
+  ~SequenceReader(){
+    gzclose(file);
+  }
+
+  SequenceReader(const SequenceReader&) = delete;
+  SequenceReader& operator=(const SequenceReader&) = delete;
+
+  // Reads the next record. Returns false at the end of the file.
+  bool next_read(string& header, string& sequence){
+    sequence.clear();
+    if(!read_line(header)) return false;
+    if(header.empty() || header[0] != (fastq ? '@' : '>'))
+      throw std::runtime_error("Malformed record in " + filename + ": " + header);
+    header.erase(0, 1);
+    if(fastq){
+      string line;
+      if(!read_line(sequence) || !read_line(line) || !read_line(line))
+        throw std::runtime_error("Truncated FASTQ record in " + filename);
+    } else {
+      string line;
+      while(peek() != '>' && peek() != EOF){
+        read_line(line);
+        sequence += line;
+      }
+    }
+    return true;
+  }
+
+  // Fills `batch` with maximal runs of A,C,G,T of at least min_length characters
+  // (lowercase is converted to uppercase) until it holds about max_bases characters.
+  // Returns false if the file had nothing left.
+  bool read_batch(vector<string>& batch, int64_t max_bases, int64_t min_length){
+    batch.clear();
+    int64_t bases = 0;
+    bool any = false;
+    string header, sequence;
+    while(bases < max_bases && next_read(header, sequence)){
+      any = true;
+      split_at_non_ACGT(sequence, min_length, batch, bases);
+    }
+    return any;
+  }
+
+  // Appends the maximal runs of A,C,G,T in S that have at least min_length characters
+  static void split_at_non_ACGT(string& S, int64_t min_length, vector<string>& pieces, int64_t& bases){
+    int64_t start = 0;
+    for(int64_t i = 0; i <= (int64_t)S.size(); i++){
+      char c = i < (int64_t)S.size() ? toupper(S[i]) : 'N';
+      if(c == 'A' || c == 'C' || c == 'G' || c == 'T'){
+        S[i] = c;
+        continue;
+      }
+      if(i - start >= min_length){
+        pieces.push_back(S.substr(start, i - start));
+        bases += i - start;
+      }
+      start = i + 1;
+    }
+  }
+
+private:
+  string filename;
+  gzFile file;
+  bool fastq = false;
+  vector<char> buffer;
+  int64_t buffer_pos = 0;
+  int64_t buffer_end = 0;
+
+  bool refill(){
+    int n = gzread(file, buffer.data(), buffer.size());
+    if(n < 0) throw std::runtime_error("Error reading " + filename);
+    buffer_pos = 0;
+    buffer_end = n;
+    return n > 0;
+  }
+
+  int peek(){
+    if(buffer_pos == buffer_end && !refill()) return EOF;
+    return (unsigned char)buffer[buffer_pos];
+  }
+
+  // Reads a line without the newline (and carriage return). Returns false at the end of the file.
+  bool read_line(string& line){
+    line.clear();
+    if(peek() == EOF) return false;
+    while(peek() != EOF){
+      char* begin = buffer.data() + buffer_pos;
+      char* end = buffer.data() + buffer_end;
+      char* newline = (char*)memchr(begin, '\n', end - begin);
+      if(newline != nullptr){
+        line.append(begin, newline);
+        buffer_pos += newline - begin + 1;
+        break;
+      }
+      line.append(begin, end);
+      buffer_pos = buffer_end;
+    }
+    if(!line.empty() && line.back() == '\r') line.pop_back();
+    return true;
+  }
+};
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <memory>
+#include <stdexcept>
+#include "index_file.h"
+
+using std::string;
+using std::vector;
+
+// Array that either owns its elements or refers to elements in memory owned by
+// someone else, such as a memory-mapped index file. Borrowed arrays are read-only.
+template <typename T>
+class Array{
+public:
+  Array() {}
+  Array(int64_t n, const T& value = T()) : owned(n, value) { refresh(); }
+  Array(const T* data, int64_t n) : ptr(const_cast<T*>(data)), n(n) {}
+  Array(const Array& other) { *this = other; }
+  Array(Array&& other) noexcept { *this = std::move(other); }
+
+  Array& operator=(const Array& other){
+    owned = other.owned;
+    if(other.borrowed()){
+      ptr = other.ptr;
+      n = other.n;
+    } else refresh();
+    return *this;
+  }
+
+  Array& operator=(Array&& other) noexcept {
+    bool other_borrowed = other.borrowed();
+    owned = std::move(other.owned);
+    if(other_borrowed){
+      ptr = other.ptr;
+      n = other.n;
+    } else refresh();
+    other.owned.clear();
+    other.refresh();
+    return *this;
+  }
+
+  T& operator[](int64_t i) { return ptr[i]; }
+  const T& operator[](int64_t i) const { return ptr[i]; }
+  int64_t size() const { return n; }
+  const T* data() const { return ptr; }
+  const T* begin() const { return ptr; }
+  const T* end() const { return ptr + n; }
+  bool borrowed() const { return ptr != owned.data(); }
+
+  // Modifiers for building. Only valid for owned arrays.
+  void assign(int64_t count, T value){ owned.assign(count, value); refresh(); }
+  void resize(int64_t count){ owned.resize(count); refresh(); }
+  void push_back(T x){ owned.push_back(x); refresh(); }
+  void clear(){ owned.clear(); refresh(); }
+
+private:
+  vector<T> owned;
+  T* ptr = nullptr;
+  int64_t n = 0;
+
+  void refresh(){
+    ptr = owned.data();
+    n = owned.size();
+  }
+};
+
+class IndexWriter{
+public:
+  IndexWriter(const string& filename, uint32_t type) : filename(filename) {
+    f = fopen(filename.c_str(), "wb");
+    if(f == nullptr) throw std::runtime_error("Could not open " + filename + " for writing");
+    index_write_header(f, type);
+  }
+  ~IndexWriter(){
+    if(f != nullptr) fclose(f);
+  }
+
+  void write_scalar(int64_t x){ index_write_scalar(f, x); }
+
+  template <typename T>
+  void write_array(const Array<T>& A){ index_write_array(f, A.data(), A.size() * sizeof(T)); }
+
+  template <typename T>
+  void write_array(const vector<T>& A){ index_write_array(f, A.data(), A.size() * sizeof(T)); }
+
+  // Must be called to check for write errors
+  void close(){
+    bool failed = ferror(f) != 0;
+    if(fclose(f) != 0) failed = true;
+    f = nullptr;
+    if(failed) throw std::runtime_error("Error writing " + filename);
+  }
+
+private:
+  string filename;
+  FILE* f;
+};
+
+// Arrays read from an IndexReader point into the mapping. The mapping is shared
+// and stays alive as long as some structure holds the pointer from mapping().
+class IndexReader{
+public:
+  IndexReader(const string& filename, uint32_t type) : filename(filename) {
+    IndexFile* file = new IndexFile;
+    const char* error = index_map(file, filename.c_str(), type);
+    if(error != nullptr){
+      delete file;
+      throw std::runtime_error(filename + ": " + error);
+    }
+    this->file = std::shared_ptr<IndexFile>(file, [](IndexFile* f){ index_unmap(f); delete f; });
+  }
+
+  int64_t read_scalar(){
+    int64_t x = index_read_scalar(file.get());
+    check();
+    return x;
+  }
+
+  template <typename T>
+  Array<T> read_array(){
+    int64_t n_bytes;
+    const void* data = index_read_array(file.get(), &n_bytes);
+    check();
+    return Array<T>((const T*)data, n_bytes / sizeof(T));
+  }
+
+  template <typename T>
+  vector<T> read_vector(){
+    Array<T> A = read_array<T>();
+    return vector<T>(A.begin(), A.end());
+  }
+
+  std::shared_ptr<const void> mapping() const { return file; }
+
+private:
+  string filename;
+  std::shared_ptr<IndexFile> file;
+
+  void check(){
+    if(file->error) throw std::runtime_error(filename + ": index file is truncated");
+  }
+};
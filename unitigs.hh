@@ -0,0 +1,204 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <iostream>
+#include "select_free_boss.hh"
+
+using std::string;
+using std::vector;
+
+// A maximal non-branching path of k-mers: its spelled sequence, the colex ranks of its
+// first and last node, and the nodes that the last node reaches with A, C, G, T (-1 if none)
+struct Unitig{
+  string sequence;
+  int64_t first_node;
+  int64_t last_node;
+  int64_t successors[4];
+};
+
+// Compacts the k-mers of the structure into maximal unitigs. The dummies and the root are
+// not part of the graph. An edge u -> v joins two k-mers of the same unitig when u has no
+// other successor and v has no other predecessor among the k-mers; every other k-mer starts
+// a unitig.
+//
+// The nodes are split into colex-rank ranges, more than there are threads so that ranges of
+// uneven work balance out. Each range walks the unitigs that start in it, marking their nodes
+// in a shared visited bitmap with atomic word updates. The k-mers left unmarked then lie on
+// cycles without a branch. Each cycle is emitted by its smallest node, which the range that
+// holds it recognizes by walking the cycle until it meets a smaller node or returns to itself.
+// The output is in range order, so it does not depend on the number of threads.
+//
+// The suffix groups come from the LCS array if the index has one. Otherwise the last k-1
+// characters of every pair of neighbouring nodes are compared in k-1 parallel rounds, each
+// of which steps both nodes of every undecided pair back to their unmarked predecessors.
+inline vector<Unitig> extract_unitigs(const SelectFreeBOSS& boss, int n_threads = 1){
+  int64_t n = boss.node_count;
+  int k = boss.k;
+  n_threads = std::max(n_threads, 1);
+  int64_t n_parts = 8 * n_threads;
+  vector<int64_t> ranges = split_range(n, n_parts);
+
+  // The unmarked predecessor of every node. The edges with c from a range start at node
+  // C[c] + rank(c, range start), so each range fills its share without the others.
+  vector<int64_t> predecessor(n, -1);
+  parallel_for(n_parts, n_threads, [&](int64_t t){
+    int64_t next[4];
+    for(int c = 0; c < 4; c++) next[c] = boss.C["ACGT"[c]] + boss.rank("ACGT"[c], ranges[t]);
+    for(int64_t u = ranges[t]; u < ranges[t+1]; u++){
+      uint8_t out = boss.out_edges(u);
+      for(int c = 0; c < 4; c++)
+        if((out >> c) & 1) predecessor[next[c]++] = u;
+    }
+  });
+
+  vector<uint8_t> not_kmer(n, 0); // The root and the dummies
+  if(n > 0) not_kmer[0] = 1;
+  count_dummies(n, k, [&](int64_t u, vector<int64_t>& out){
+    uint8_t mask = boss.out_edges(u);
+    for(int c = 0; c < 4; c++){
+      if(((mask >> c) & 1) == 0) continue;
+      out.push_back(boss.C["ACGT"[c]] + boss.rank("ACGT"[c], u));
+      not_kmer[out.back()] = 1;
+    }
+  });
+
+  // same_group[i]: nodes i-1 and i are in the same suffix group
+  vector<uint8_t> same_group(n, 0);
+  if(boss.has_lcs()){
+    parallel_for(n_parts, n_threads, [&](int64_t t){
+      for(int64_t i = std::max<int64_t>(ranges[t], 1); i < ranges[t+1]; i++) same_group[i] = boss.LCS[i] >= k - 1;
+    });
+  } else {
+    vector<int64_t> previous(n), current(n); // The pair of node i after the steps so far
+    parallel_for(n_parts, n_threads, [&](int64_t t){
+      for(int64_t i = std::max<int64_t>(ranges[t], 1); i < ranges[t+1]; i++){
+        previous[i] = i - 1, current[i] = i;
+        same_group[i] = 1;
+      }
+    });
+    for(int round = 0; round < k - 1; round++){
+      parallel_for(n_parts, n_threads, [&](int64_t t){
+        for(int64_t i = std::max<int64_t>(ranges[t], 1); i < ranges[t+1]; i++){
+          if(!same_group[i]) continue;
+          char c = boss.incoming_character(previous[i]);
+          if(c == '$' || c != boss.incoming_character(current[i])) same_group[i] = 0;
+          else previous[i] = predecessor[previous[i]], current[i] = predecessor[current[i]];
+        }
+      });
+    }
+  }
+  auto suffix_group = [&](int64_t u, int64_t& first, int64_t& last){
+    first = last = u;
+    while(first > 0 && same_group[first]) first--;
+    while(last + 1 < n && same_group[last + 1]) last++;
+  };
+
+  // The successors of u with A, C, G, T, and their number
+  auto successors = [&](int64_t u, int64_t* next){
+    int64_t first, last;
+    suffix_group(u, first, last);
+    int count = 0;
+    for(int c = 0; c < 4; c++){
+      next[c] = -1;
+      for(int64_t i = first; i <= last && next[c] < 0; i++)
+        if((boss.out_edges(i) >> c) & 1) next[c] = boss.C["ACGT"[c]] + boss.rank("ACGT"[c], i);
+      count += next[c] >= 0;
+    }
+    return count;
+  };
+  // The only successor of u, or -1 if u branches or is a dead end
+  auto unique_successor = [&](int64_t u) -> int64_t {
+    int64_t next[4];
+    if(successors(u, next) != 1) return -1;
+    return *std::max_element(next, next + 4);
+  };
+  // The only predecessor of v among the k-mers, or -1 if there is none or more than one.
+  // The predecessors of v are the suffix group of its unmarked predecessor.
+  auto unique_predecessor = [&](int64_t v) -> int64_t {
+    int64_t first, last, found = -1;
+    suffix_group(predecessor[v], first, last);
+    for(int64_t i = first; i <= last; i++){
+      if(not_kmer[i]) continue;
+      if(found >= 0) return -1;
+      found = i;
+    }
+    return found;
+  };
+  auto starts_unitig = [&](int64_t v){
+    int64_t u = unique_predecessor(v);
+    return u < 0 || unique_successor(u) != v;
+  };
+
+  vector<std::atomic<uint64_t>> visited((n + 63) / 64);
+  for(std::atomic<uint64_t>& word : visited) word.store(0, std::memory_order_relaxed);
+  auto walk = [&](int64_t start){
+    Unitig unitig;
+    unitig.sequence.assign(k, '$');
+    for(int64_t i = k - 1, x = start; i >= 0 && x > 0; i--, x = predecessor[x])
+      unitig.sequence[i] = boss.incoming_character(x);
+    unitig.first_node = unitig.last_node = start;
+    visited[start / 64].fetch_or(uint64_t(1) << (start % 64), std::memory_order_relaxed);
+    while(true){
+      int64_t v = unique_successor(unitig.last_node);
+      if(v < 0 || v == start || unique_predecessor(v) < 0) break;
+      unitig.sequence += boss.incoming_character(v);
+      unitig.last_node = v;
+      visited[v / 64].fetch_or(uint64_t(1) << (v % 64), std::memory_order_relaxed);
+    }
+    successors(unitig.last_node, unitig.successors);
+    return unitig;
+  };
+
+  vector<vector<Unitig>> paths(n_parts), cycles(n_parts);
+  parallel_for(n_parts, n_threads, [&](int64_t t){
+    for(int64_t v = ranges[t]; v < ranges[t+1]; v++)
+      if(!not_kmer[v] && starts_unitig(v)) paths[t].push_back(walk(v));
+  });
+  parallel_for(n_parts, n_threads, [&](int64_t t){
+    for(int64_t v = ranges[t]; v < ranges[t+1]; v++){
+      if(not_kmer[v] || ((visited[v / 64].load(std::memory_order_relaxed) >> (v % 64)) & 1)) continue;
+      int64_t x = unique_successor(v);
+      while(x > v) x = unique_successor(x);
+      if(x == v) cycles[t].push_back(walk(v));
+    }
+  });
+
+  vector<Unitig> unitigs;
+  for(vector<vector<Unitig>>* parts : {&paths, &cycles})
+    for(vector<Unitig>& part : *parts)
+      for(Unitig& unitig : part) unitigs.push_back(std::move(unitig));
+  return unitigs;
+}
+
+// One record per unitig, named by its number
+inline void write_unitigs_fasta(std::ostream& out, const vector<Unitig>& unitigs){
+  for(int64_t i = 0; i < (int64_t)unitigs.size(); i++)
+    out << '>' << i << '\n' << unitigs[i].sequence << '\n';
+}
+
+// GFA 1: a segment per unitig, named by its number as in the FASTA output, and a link for
+// every edge from the last k-mer of a unitig to the first k-mer of another, overlapping by
+// k-1 characters. The graph has one strand: an index of both strands has every unitig in
+// both orientations.
+inline void write_unitigs_gfa(std::ostream& out, const SelectFreeBOSS& boss, const vector<Unitig>& unitigs){
+  vector<std::pair<int64_t, int64_t>> by_first_node; // First node, unitig
+  for(int64_t i = 0; i < (int64_t)unitigs.size(); i++) by_first_node.push_back({unitigs[i].first_node, i});
+  std::sort(by_first_node.begin(), by_first_node.end());
+
+  out << "H\tVN:Z:1.0" << '\n';
+  for(int64_t i = 0; i < (int64_t)unitigs.size(); i++)
+    out << "S\t" << i << '\t' << unitigs[i].sequence << "\tLN:i:" << unitigs[i].sequence.size() << '\n';
+  for(int64_t i = 0; i < (int64_t)unitigs.size(); i++){
+    for(int c = 0; c < 4; c++){
+      int64_t v = unitigs[i].successors[c];
+      if(v < 0) continue;
+      auto it = std::lower_bound(by_first_node.begin(), by_first_node.end(), std::make_pair(v, int64_t(0)));
+      if(it == by_first_node.end() || it->first != v) continue;
+      out << "L\t" << i << "\t+\t" << it->second << "\t+\t" << boss.k - 1 << "M" << '\n';
+    }
+  }
+}
@@ -0,0 +1,179 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include "wheeler_boss.hh"
+
+using std::cout;
+using std::string;
+using std::vector;
+
+// Checks that every node labeled by a k-mer is found at its position in the colex-sorted
+// node list, and that k-mers that are not nodes are not found
+template <typename kmer_t>
+void check_search(const WheelerBOSS& boss, const vector<string>& input, int k, const string& name, bool minimal_dummies = false){
+  vector<KmerNode<kmer_t>> nodes = construct_node_list<kmer_t>(input, k);
+  if(minimal_dummies) remove_redundant_dummies(nodes, k);
+  vector<string> labels;
+  for(int64_t i = 0; i < (int64_t)nodes.size(); i++){
+    if(nodes[i].length < k) continue;
+    string kmer = decode_label(nodes[i], k);
+    labels.push_back(kmer);
+    if(WheelerBOSS_search(&boss, kmer.c_str(), k) != i)
+      cout << "ERROR: " << name << " returned a wrong answer for k-mer " << kmer << '\n';
+  }
+  std::sort(labels.begin(), labels.end());
+  for(string kmer : labels){
+    std::reverse(kmer.begin(), kmer.end());
+    if(!std::binary_search(labels.begin(), labels.end(), kmer) && WheelerBOSS_search(&boss, kmer.c_str(), k) != -1)
+      cout << "ERROR: " << name << " found k-mer " << kmer << " even though it's not supposed to" << '\n';
+  }
+}
+
+// Checks the counts of the stats against the node list
+template <typename kmer_t>
+void check_stats(const WheelerBOSS& boss, const vector<string>& input, int k){
+  int64_t n_kmers = 0, n_dummies = 0, n_edges = 0;
+  for(const KmerNode<kmer_t>& node : construct_node_list<kmer_t>(input, k)){
+    n_kmers += node.length == k;
+    n_dummies += node.length > 0 && node.length < k;
+    n_edges += __builtin_popcount(node.edges & 0xF);
+  }
+  IndexStats stats = index_stats(boss, k);
+  if(stats.n_kmers() != n_kmers || stats.n_dummies != n_dummies || stats.n_edges != n_edges)
+    cout << "ERROR: wrong stats for k = " << k << '\n' << stats;
+}
+
+// Checks the navigation against the node list: labels, degrees, forward steps, and
+// backward steps against the forward steps of all nodes
+template <typename kmer_t>
+void check_navigation(const WheelerBOSS& boss, const vector<KmerNode<kmer_t>>& nodes, int k, const string& name){
+  vector<vector<int64_t>> expected_predecessors(nodes.size());
+  string label(k, ' ');
+  for(int64_t u = 0; u < (int64_t)nodes.size(); u++){
+    WheelerBOSS_label(&boss, u, k, &label[0]);
+    if(label != decode_label(nodes[u], k) || WheelerBOSS_outdegree(&boss, u) != __builtin_popcount(nodes[u].edges & 0xF))
+      cout << "ERROR: wrong label or outdegree of node " << u << " in " << name << '\n';
+    for(int c = 0; c < 4; c++){
+      int64_t v = WheelerBOSS_forward(&boss, u, "ACGT"[c]);
+      if(((nodes[u].edges >> c) & 1) != (v >= 0) || (v >= 0 && decode_label(nodes[v], k) != (label + "ACGT"[c]).substr(1)))
+        cout << "ERROR: wrong forward step from node " << u << " with " << "ACGT"[c] << " in " << name << '\n';
+      if(v >= 0) expected_predecessors[v].push_back(u);
+    }
+  }
+  for(int64_t v = 0; v < (int64_t)nodes.size(); v++){
+    vector<int64_t> found;
+    for(int64_t i = 0; i < WheelerBOSS_indegree(&boss, v); i++) found.push_back(WheelerBOSS_backward(&boss, v, i));
+    if(found != expected_predecessors[v] || WheelerBOSS_backward(&boss, v, found.size()) != -1)
+      cout << "ERROR: wrong predecessors of node " << v << " in " << name << '\n';
+  }
+}
+
+// The bits of I or O, or the characters of the GBWT, as a string
+string to_string(const PackedBitVector& B, int64_t length){
+  string S;
+  for(int64_t i = 0; i < length; i++) S += Access(&B, i) ? '1' : '0';
+  return S;
+}
+string to_string(const PackedDNA& P, int64_t length){
+  string S;
+  for(int64_t i = 0; i < length; i++)
+    for(char c : {'A', 'C', 'G', 'T'})
+      if(DNA_Rank(&P, c, i+1) > DNA_Rank(&P, c, i)) S += c;
+  return S;
+}
+
+int main(int argc, char** argv){
+  if(argc >= 2){ // wheeler_boss input.fasta[.gz] k [output.index] [--compressed] [--minimal-dummies]
+    vector<string> args;
+    bool compressed = false, minimal_dummies = false;
+    for(int i = 1; i < argc; i++){
+      string arg = argv[i];
+      if(arg == "--compressed") compressed = true;
+      else if(arg == "--minimal-dummies") minimal_dummies = true;
+      else args.push_back(arg);
+    }
+    if(args.size() < 2 || args.size() > 3){
+      std::cerr << "Usage: " << argv[0] << " input.fasta[.gz] k [output.index] [--compressed] [--minimal-dummies]" << '\n';
+      return 1;
+    }
+    int64_t k = 0;
+    size_t k_end = 0;
+    try{ k = std::stoll(args[1], &k_end); } catch(const std::exception&){}
+    if(k_end != args[1].size() || k < 1 || k > 64){
+      std::cerr << "ERROR: k must be an integer from 1 to 64, got " << args[1] << '\n';
+      return 1;
+    }
+    try{
+      SequenceReader reader(args[0]);
+      int64_t removed_dummies = 0;
+      WheelerBOSS boss = construct_wheeler_boss(reader, (int)k, std::thread::hardware_concurrency(), 1 << 28, minimal_dummies, &removed_dummies);
+      if(minimal_dummies) cout << "Redundant dummies removed: " << removed_dummies << '\n';
+      if(compressed) WheelerBOSS_compress(&boss);
+      cout << index_stats(boss, (int)k);
+      bool written = args.size() < 3 || WheelerBOSS_save(&boss, args[2].c_str()) == 0;
+      WheelerBOSS_free(&boss);
+      if(!written){
+        std::cerr << "ERROR: could not write " << args[2] << '\n';
+        return 1;
+      }
+    } catch(const std::exception& e){
+      std::cerr << "ERROR: " << e.what() << '\n';
+      return 1;
+    }
+    return 0;
+  }
+
+  // The sequences behind the example in main_with_end_sentinel.c. Its cycle CGC -> GCG -> CGC
+  // has no dummy nodes leading to it, so the example has only the dummies that are needed.
+  vector<string> example = {"ACACGTA", "AGTA", "CGCGCGA"};
+  int64_t removed_dummies = 0;
+  WheelerBOSS boss = construct_wheeler_boss(example, 3, 1, true, &removed_dummies);
+  check_search<uint64_t>(boss, example, 3, "the example", true);
+  int64_t length = boss.n_nodes + boss.n_edges + 1;
+  if(to_string(boss.I, length) != "110101010010101010101010101" || to_string(boss.O, length) != "101001011101010101010010101"
+     || to_string(boss.GBWT, boss.n_edges) != "ACGCAGGTTACAA" || removed_dummies != 2
+     || index_stats(boss, 3).n_kmers() != 9 || index_stats(boss, 3).n_dummies != 3)
+    cout << "ERROR: the example differs from the one in main_with_end_sentinel.c" << '\n';
+  WheelerBOSS_free(&boss);
+
+  vector<string> input = {"GAAGCCGCCATTCCATAGTGAGTCCTTCGTCTGTGACTATCTGTGCCAGATCGTCTAGCAAACTGCTGATCCAGTTTATCTCACCAAATTATAGCCGTACAGACCGAAATCTTAAGTCATATCACGCGACTAGGCTCAGCTTTATTTTTGTGGTCATGGGTTTTGGTCCGCCCGAGCGGTGCAGCCGATTAGGACCATGT"};
+  for(int k : {1, 4, 31, 40}){
+    boss = construct_wheeler_boss(input, k, std::thread::hardware_concurrency());
+    cout << "k = " << k << ": " << boss.n_nodes << " nodes, " << boss.n_edges << " edges" << '\n';
+    if(k <= 32) check_search<uint64_t>(boss, input, k, "the constructed index");
+    else check_search<__uint128_t>(boss, input, k, "the constructed index");
+
+    // Check the counts of the stats and the navigation, also in the compressed representation
+    for(int compressed = 0; compressed < 2; compressed++){
+      if(k <= 32) check_stats<uint64_t>(boss, input, k);
+      else check_stats<__uint128_t>(boss, input, k);
+      if(k <= 32) check_navigation(boss, construct_node_list<uint64_t>(input, k), k, "the constructed index");
+      else check_navigation(boss, construct_node_list<__uint128_t>(input, k), k, "the constructed index");
+      if(compressed == 0) WheelerBOSS_compress(&boss);
+    }
+
+    // Check the index without redundant dummies on overlapping pieces of the input
+    vector<string> pieces;
+    for(int64_t i = 0; i + 2*k <= (int64_t)input[0].size(); i += k) pieces.push_back(input[0].substr(i, 2*k));
+    WheelerBOSS minimal = construct_wheeler_boss(pieces, k, std::thread::hardware_concurrency(), true);
+    if(k <= 32) check_search<uint64_t>(minimal, pieces, k, "the index without redundant dummies", true);
+    else check_search<__uint128_t>(minimal, pieces, k, "the index without redundant dummies", true);
+    WheelerBOSS_free(&minimal);
+
+    // Check the compressed representation, also after saving and loading
+    const char* filename = "wheeler_boss_test.index";
+    WheelerBOSS loaded;
+    if(WheelerBOSS_save(&boss, filename) != 0 || WheelerBOSS_load(&loaded, filename) != NULL){
+      cout << "ERROR: could not save and load the index" << '\n';
+    } else {
+      if(k <= 32) check_search<uint64_t>(loaded, input, k, "the loaded compressed index");
+      else check_search<__uint128_t>(loaded, input, k, "the loaded compressed index");
+      WheelerBOSS_unload(&loaded);
+    }
+    std::remove(filename);
+    WheelerBOSS_free(&boss);
+  }
+}
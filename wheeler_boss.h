@@ -0,0 +1,164 @@
+#pragma once
+
+#include "inttypes.h"
+#include "stdio.h"
+#include "assert.h"
+#include "stdlib.h"
+#include "rank_select.h"
+#include "index_file.h"
+
+typedef struct WheelerBOSS{
+
+    PackedBitVector I; // Packed bit vector with rank and select support
+    PackedBitVector O; // Packed bit vector with rank and select support
+    PackedDNA GBWT; // Generalized BWT = string characters 'A', 'C', 'G' and 'T', packed with rank support
+    int64_t* C; // Has constant length 256
+    int64_t n_nodes;
+    int64_t n_edges;
+    IndexFile mapping; // Set if the structure was loaded from an index file
+
+} WheelerBOSS;
+
+// Colexicographic rank of the node labeled by the k-mer, or -1 if it does not exist.
+// Requires the end sentinel: I and O end in an extra '1', so that the last node needs
+// no special case when finding the end of its out-edges.
+static inline int64_t WheelerBOSS_search(const WheelerBOSS* boss, const char* kmer, int64_t k){
+    int64_t left = 0;
+    int64_t right = boss->n_nodes-1;
+    BOSS_COUNT(queries);
+    for(int64_t i = 0; i < k; i++){
+        char c = kmer[i];
+
+        int64_t start = Select(&boss->O, '1', left+1) - left;
+        int64_t end = Select(&boss->O, '1', right+2) - right - 2;
+
+        BOSS_COUNT(search_steps);
+        if(end < start){ // K-mer not found
+            if(i + 1 < k) BOSS_COUNT(early_terminations);
+            return -1;
+        }
+
+        int64_t edge_left = DNA_Rank(&boss->GBWT, c, start);
+        int64_t edge_right = DNA_Rank(&boss->GBWT, c, end+1);
+
+        if(edge_left == edge_right){ // K-mer not found
+            if(i + 1 < k) BOSS_COUNT(early_terminations);
+            return -1;
+        }
+
+        int64_t edge_wheeler_left = boss->C[(unsigned char)c] + edge_left;
+        int64_t edge_wheeler_right = boss->C[(unsigned char)c] + edge_right - 1;
+
+        left = Rank(&boss->I, '1', Select(&boss->I, '0', edge_wheeler_left+1))-1;
+        right = Rank(&boss->I, '1', Select(&boss->I, '0', edge_wheeler_right+1))-1;
+    }
+
+    assert(left == right); // If this is wrong then the WheelerBOSS is corrupt or the k is wrong.
+    return left;
+}
+
+// Navigation of the graph by colex rank. O lists the out-edges of each node and I the
+// in-edges, both in Wheeler order, so each step is a few rank and select queries.
+
+static inline int64_t WheelerBOSS_outdegree(const WheelerBOSS* boss, int64_t node){
+    return Select(&boss->O, '1', node+2) - Select(&boss->O, '1', node+1) - 1;
+}
+
+static inline int64_t WheelerBOSS_indegree(const WheelerBOSS* boss, int64_t node){
+    return Select(&boss->I, '1', node+2) - Select(&boss->I, '1', node+1) - 1;
+}
+
+// The node reached from `node` with character c, or -1 if there is no such edge
+static inline int64_t WheelerBOSS_forward(const WheelerBOSS* boss, int64_t node, char c){
+    if(DNA_to_code(c) < 0) return -1;
+    int64_t start = Select(&boss->O, '1', node+1) - node;
+    int64_t end = Select(&boss->O, '1', node+2) - node - 2;
+    int64_t edge = DNA_Rank(&boss->GBWT, c, start);
+    if(DNA_Rank(&boss->GBWT, c, end+1) == edge) return -1; // Also if the node has no out-edges
+    return Rank(&boss->I, '1', Select(&boss->I, '0', boss->C[(unsigned char)c] + edge + 1)) - 1;
+}
+
+// Last character of the label of the node, or '$' for the root. It is the character of
+// all in-edges of the node, found from the C bucket of the first one.
+static inline char WheelerBOSS_incoming_character(const WheelerBOSS* boss, int64_t node){
+    if(WheelerBOSS_indegree(boss, node) == 0) return '$';
+    int64_t edge = Select(&boss->I, '1', node+1) - node;
+    const char* characters = "TGCA";
+    for(int64_t i = 0; i < 4; i++)
+        if(edge >= boss->C[(unsigned char)characters[i]]) return characters[i];
+    return '$';
+}
+
+// Source of the i-th in-edge of the node (0-based, sources in colex order), or -1 if
+// the node has at most i in-edges
+static inline int64_t WheelerBOSS_backward(const WheelerBOSS* boss, int64_t node, int64_t i){
+    if(i >= WheelerBOSS_indegree(boss, node)) return -1;
+    char c = WheelerBOSS_incoming_character(boss, node);
+    int64_t edge = Select(&boss->I, '1', node+1) - node + i;
+    int64_t position = DNA_Select(&boss->GBWT, c, edge - boss->C[(unsigned char)c] + 1);
+    return Rank(&boss->O, '1', Select(&boss->O, '0', position+1)) - 1;
+}
+
+// Writes the k characters of the label of the node to `label`, padded with dollars at
+// the start for the root and the dummies. Takes up to k backward steps.
+static inline void WheelerBOSS_label(const WheelerBOSS* boss, int64_t node, int64_t k, char* label){
+    for(int64_t i = k-1; i >= 0; i--){
+        label[i] = node >= 0 ? WheelerBOSS_incoming_character(boss, node) : '$';
+        if(label[i] == '$') node = -1;
+        else node = WheelerBOSS_backward(boss, node, 0);
+    }
+}
+
+// Frees a structure that was built in memory. Use WheelerBOSS_unload for loaded ones.
+static inline void WheelerBOSS_free(WheelerBOSS* boss){
+    PackedBitVector_free(&boss->I);
+    PackedBitVector_free(&boss->O);
+    PackedDNA_free(&boss->GBWT);
+    free(boss->C);
+}
+
+// Switches I and O to the RRR compressed representation. Called at build time; the
+// choice is stored in the index file. Searches get slower in exchange for the space.
+static inline void WheelerBOSS_compress(WheelerBOSS* boss){
+    PackedBitVector_compress(&boss->I);
+    PackedBitVector_compress(&boss->O);
+}
+
+// Writes the structure to a binary index file. Returns 0 on success.
+static inline int WheelerBOSS_save(const WheelerBOSS* boss, const char* filename){
+    FILE* f = fopen(filename, "wb");
+    if(f == NULL) return -1;
+    index_write_header(f, INDEX_WHEELER_BOSS);
+    index_write_scalar(f, boss->n_nodes);
+    index_write_scalar(f, boss->n_edges);
+    index_write_array(f, boss->C, 256 * sizeof(int64_t));
+    PackedBitVector_write(f, &boss->I);
+    PackedBitVector_write(f, &boss->O);
+    PackedDNA_write(f, &boss->GBWT);
+    int failed = ferror(f);
+    if(fclose(f) != 0) failed = 1;
+    return failed ? -1 : 0;
+}
+
+// Maps an index file into memory so that it can be queried in place.
+// Returns NULL on success and an error message otherwise.
+static inline const char* WheelerBOSS_load(WheelerBOSS* boss, const char* filename){
+    const char* error = index_map(&boss->mapping, filename, INDEX_WHEELER_BOSS);
+    if(error != NULL) return error;
+    int64_t n_bytes;
+    boss->n_nodes = index_read_scalar(&boss->mapping);
+    boss->n_edges = index_read_scalar(&boss->mapping);
+    boss->C = (int64_t*)index_read_array(&boss->mapping, &n_bytes);
+    boss->I = PackedBitVector_map(&boss->mapping);
+    boss->O = PackedBitVector_map(&boss->mapping);
+    boss->GBWT = PackedDNA_map(&boss->mapping);
+    if(boss->mapping.error){
+        index_unmap(&boss->mapping);
+        return "index file is truncated";
+    }
+    return NULL;
+}
+
+static inline void WheelerBOSS_unload(WheelerBOSS* boss){
+    index_unmap(&boss->mapping);
+}
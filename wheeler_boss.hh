@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include "wheeler_boss.h"
+#include "kmer_nodes.hh"
+#include "sequence_reader.hh"
+#include "index_stats.hh"
+
+using std::string;
+using std::vector;
+
+// Construction of the node-centric WheelerBOSS (wheeler_boss.h) from sequences. The
+// nodes are the same colex-sorted k-mers and dummies as in the other structures, and
+// the edges are the (k+1)-mers of the input. The result has the end sentinel, so it is
+// searched with WheelerBOSS_search, and its arrays are freed with WheelerBOSS_free.
+
+// Builds the structure from the colex-sorted node list, which must start with the root.
+// Edges are numbered in Wheeler order: by label, and by source node within a label. The
+// targets are then in node order, and an edge points to a new node exactly when it is not
+// minus-marked, so I is written from the minus marks without finding any targets.
+template <typename kmer_t>
+WheelerBOSS construct_wheeler_boss(const vector<KmerNode<kmer_t>>& nodes, int k, int n_threads = 1){
+  if(nodes.empty() || nodes[0].length != 0) throw std::invalid_argument("The node list has no root");
+  vector<uint8_t> unmarked = unmarked_out_edges(nodes, k, n_threads);
+
+  WheelerBOSS boss;
+  boss.n_nodes = nodes.size();
+  boss.n_edges = 0;
+  int64_t counts[4] = {0, 0, 0, 0};
+  for(const KmerNode<kmer_t>& node : nodes)
+    for(int c = 0; c < 4; c++) counts[c] += (node.edges >> c) & 1;
+  for(int c = 0; c < 4; c++) boss.n_edges += counts[c];
+
+  boss.C = (int64_t*)calloc(256, sizeof(int64_t));
+  for(int c = 1; c < 4; c++) boss.C[(unsigned char)"ACGT"[c]] = boss.C[(unsigned char)"ACGT"[c-1]] + counts[c-1];
+
+  // O: a one for each node followed by a zero for each out-edge. GBWT: the out-edge labels.
+  boss.O = PackedBitVector_new(boss.n_nodes + boss.n_edges + 1);
+  boss.GBWT = PackedDNA_new(boss.n_edges);
+  int64_t bit = 0, edge = 0;
+  for(const KmerNode<kmer_t>& node : nodes){
+    PackedBitVector_set(&boss.O, bit++);
+    for(int c = 0; c < 4; c++){
+      if(((node.edges >> c) & 1) == 0) continue;
+      PackedDNA_set(&boss.GBWT, edge++, c);
+      bit++;
+    }
+  }
+  PackedBitVector_set(&boss.O, bit); // End sentinel
+
+  // I: a one for each node followed by a zero for each in-edge. The root has no in-edges.
+  boss.I = PackedBitVector_new(boss.n_nodes + boss.n_edges + 1);
+  bit = 0;
+  if(!nodes.empty()) PackedBitVector_set(&boss.I, bit++);
+  for(int c = 0; c < 4; c++){
+    for(int64_t i = 0; i < boss.n_nodes; i++){
+      if(((nodes[i].edges >> c) & 1) == 0) continue;
+      if((unmarked[i] >> c) & 1) PackedBitVector_set(&boss.I, bit++);
+      bit++;
+    }
+  }
+  if(bit != boss.n_nodes + boss.n_edges) throw std::logic_error("Some non-root node has no in-edge");
+  PackedBitVector_set(&boss.I, bit); // End sentinel
+
+  PackedBitVector_init_support(&boss.I);
+  PackedBitVector_init_support(&boss.O);
+  PackedDNA_init_counts(&boss.GBWT);
+  boss.mapping.base = NULL;
+  return boss;
+}
+
+// Builds the structure from the node list of the input, which has every dummy. With
+// minimal_dummies, only the dummies that some k-mer needs are kept (see
+// remove_redundant_dummies), and the number left out is stored in removed_dummies if given.
+template <typename kmer_t>
+WheelerBOSS construct_wheeler_boss_from_input(vector<KmerNode<kmer_t>> nodes, int k, int n_threads, bool minimal_dummies, int64_t* removed_dummies){
+  int64_t removed = minimal_dummies ? remove_redundant_dummies(nodes, k, n_threads) : 0;
+  if(removed_dummies != NULL) *removed_dummies = removed;
+  add_missing_root(nodes);
+  return construct_wheeler_boss(nodes, k, n_threads);
+}
+
+// k <= 64
+inline WheelerBOSS construct_wheeler_boss(const vector<string>& input, int k, int n_threads = 1, bool minimal_dummies = false, int64_t* removed_dummies = NULL){
+  if(k <= 32) return construct_wheeler_boss_from_input(construct_node_list<uint64_t>(input, k, n_threads), k, n_threads, minimal_dummies, removed_dummies);
+  else return construct_wheeler_boss_from_input(construct_node_list<__uint128_t>(input, k, n_threads), k, n_threads, minimal_dummies, removed_dummies);
+}
+
+// Reads the input in batches of about batch_bases characters. Sequences are split at non-ACGT characters.
+inline WheelerBOSS construct_wheeler_boss(SequenceReader& input, int k, int n_threads = 1, int64_t batch_bases = 1 << 28,
+                                          bool minimal_dummies = false, int64_t* removed_dummies = NULL){
+  auto next_batch = [&](vector<string>& batch){ return input.read_batch(batch, batch_bases, k); };
+  if(k <= 32) return construct_wheeler_boss_from_input(construct_node_list_from_batches<uint64_t>(next_batch, k, n_threads), k, n_threads, minimal_dummies, removed_dummies);
+  else return construct_wheeler_boss_from_input(construct_node_list_from_batches<__uint128_t>(next_batch, k, n_threads), k, n_threads, minimal_dummies, removed_dummies);
+}
+
+// Sizes of the components of the structure and its node counts. The structure does not
+// store k. Counting the dummies walks them from the root, which takes a few rank and
+// select queries per dummy.
+inline IndexStats index_stats(const WheelerBOSS& boss, int64_t k){
+  IndexStats stats;
+  stats.structure = "WheelerBOSS";
+  stats.k = k;
+  stats.n_nodes = boss.n_nodes;
+  stats.n_edges = boss.n_edges;
+  stats.add("I", boss.I);
+  stats.add("O", boss.O);
+  stats.add("GBWT", boss.GBWT);
+  stats.add("C array", 256 * sizeof(int64_t));
+  stats.n_dummies = count_dummies(boss.n_nodes, k, [&](int64_t u, vector<int64_t>& out){
+    int64_t begin = Select(&boss.O, '1', u + 1) - u;
+    int64_t end = Select(&boss.O, '1', u + 2) - u - 2;
+    for(int64_t e = begin; e <= end; e++){
+      int code = ((boss.GBWT.lo_bits[e >> 6] >> (e & 63)) & 1) | (((boss.GBWT.hi_bits[e >> 6] >> (e & 63)) & 1) << 1);
+      char c = "ACGT"[code];
+      int64_t edge = boss.C[(unsigned char)c] + DNA_Rank(&boss.GBWT, c, e);
+      out.push_back(Rank(&boss.I, '1', Select(&boss.I, '0', edge + 1)) - 1);
+    }
+  });
+  return stats;
+}